@@ -0,0 +1,72 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cassert>
+#include <memory>
+#include <string>
+
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/ASTMatchers/ASTMatchers.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <benchmark/benchmark.h>
+
+#include <propellint/Matcher.h>
+
+#include "MockMap.h"
+
+// A translation unit of `functions` functions, each with operator[] calls
+// nested `depth` blocks deep, matched or filtered out by the matcher.
+static std::string makeTranslationUnit(int64_t functions, int64_t depth) {
+  std::string code = kMockMapCode;
+  for (int64_t i = 0; i < functions; ++i) {
+    code += "int f" + std::to_string(i) +
+        "(std::map<int, int>& map, int key) {\n  int result = 0;\n";
+    for (int64_t j = 0; j < depth; ++j) {
+      code += "  if (key > " + std::to_string(j) + ") {\n";
+    }
+    code += R"(
+      result += map[key];
+      map[key] = result;
+      ++map[key + 1];
+      auto& value = map[key + 2];
+      result += value;
+    )";
+    for (int64_t j = 0; j < depth; ++j) {
+      code += "  }\n";
+    }
+    code += "  return result;\n}\n";
+  }
+  return code;
+}
+
+static void matchOperatorBracket(benchmark::State& state) {
+  const std::unique_ptr<clang::ASTUnit> AST = clang::tooling::buildASTFromCode(
+      makeTranslationUnit(state.range(0), state.range(1)));
+  assert(AST != nullptr);
+  auto& context = AST->getASTContext();
+
+  std::size_t matches = 0;
+  for (auto _ : state) {
+    matches = clang::ast_matchers::match(Matcher::get(), context).size();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["matches"] = matches;
+}
+BENCHMARK(matchOperatorBracket)
+    ->ArgNames({"functions", "depth"})
+    ->ArgsProduct({{10, 100, 1000}, {1, 8, 64}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,182 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <simdjson.h>
+
+#include <propellint/Profile.h>
+#include <propellint/Signatures.h>
+
+namespace json = simdjson;
+
+// A synthetic JSON profile of about `size` bytes. A quarter of the records go
+// through the operator[] of one of the default containers, half of which
+// insert. Call sites are spread over many files and lines. The records are
+// written straight into the padded buffer, and the space left after the last
+// one is filled with whitespace.
+static json::padded_string makeProfile(std::size_t size) {
+  // More than any record takes.
+  constexpr std::size_t kMaxRecordBytes = 8192;
+  const auto& containers = Signatures::Table::getDefault().getContainers();
+  std::minstd_rand generator(42);
+
+  json::padded_string profile(size + kMaxRecordBytes);
+  char* const begin = profile.data();
+  char* out = begin;
+  const auto append = [&](std::string_view text) {
+    out = std::copy(text.begin(), text.end(), out);
+  };
+  const auto frame = [&](std::string_view function) {
+    const auto id = std::to_string(generator() % 1000);
+    append("\"");
+    append(function);
+    append(id);
+    append("@service/File");
+    append(id);
+    append(".cpp:");
+    append(std::to_string(generator() % 5000));
+    append("\",");
+  };
+
+  append("[");
+  while (std::size_t(out - begin) < size) {
+    append(R"({"stack_combined":[)");
+    const auto depth = 8 + generator() % 24;
+    for (std::size_t i = 0; i < depth; ++i) {
+      frame("service::Handler::run");
+    }
+    if (generator() % 4 == 0) {
+      const auto& container = containers[generator() % containers.size()];
+      frame("service::Model::lookup");
+      append("\"");
+      append(container.operatorBracket);
+      append("@container/Map.h:100\",");
+      if (generator() % 2 == 0) {
+        append("\"");
+        append(container.inserts.front());
+        append("@container/Map.h:200\",");
+      }
+    }
+    frame("service::leaf");
+    out[-1] = ']';
+    append(R"(,"total_weight":)");
+    append(std::to_string(1 + generator() % 100));
+    append("},");
+  }
+  out[-1] = ']';
+  std::fill(out, begin + profile.size(), ' ');
+  return profile;
+}
+
+// Profiles are large, so only the last one is kept between runs.
+static const json::padded_string& getProfile(std::size_t size) {
+  static std::size_t lastSize = 0;
+  static json::padded_string profile;
+  if (size != lastSize) {
+    profile = makeProfile(size);
+    lastSize = size;
+  }
+  return profile;
+}
+
+static void parseProfileEntry(benchmark::State& state) {
+  const std::vector<std::string> entries = {
+      "folly::F14FastMap::operator[]@folly/container/F14Map.h:421",
+      "facebook::feed::Ranker::score@feed/ranker/Ranker.cpp:1287",
+      "std::_Hashtable::_M_insert_unique_node@",
+      "main",
+  };
+  for (auto _ : state) {
+    for (const auto& entry : entries) {
+      benchmark::DoNotOptimize(Profile::parseProfileEntry(entry));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * entries.size());
+}
+BENCHMARK(parseProfileEntry);
+
+// A stack of 64 frames, with the operator[] of a container in the middle, and
+// an insert frame of this container at the bottom if `insert` is set, so that
+// every frame below operator[] is checked.
+static void isInsertStack(benchmark::State& state) {
+  constexpr std::size_t kDepth = 64;
+  const auto& signatures = Signatures::Table::getDefault();
+  const auto& container = signatures.getContainers().at(state.range(0));
+  const auto insert = state.range(1) != 0;
+
+  const auto index = kDepth / 2;
+  std::vector<uint32_t> stack;
+  std::vector<Signatures::Frame> frameSignatures;
+  for (uint32_t i = 0; i < kDepth; ++i) {
+    auto function = "service::Handler::run" + std::to_string(i);
+    if (i == index) {
+      function = container.operatorBracket;
+    } else if (i == kDepth - 1 && insert) {
+      function = container.inserts.back();
+    }
+    stack.push_back(i);
+    frameSignatures.push_back(signatures.find(function));
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        Profile::isInsertStack(stack, index, frameSignatures, signatures));
+  }
+  state.SetLabel(container.operatorBracket);
+}
+BENCHMARK(isInsertStack)
+    ->ArgNames({"container", "insert"})
+    ->Apply([](benchmark::internal::Benchmark* benchmark) {
+      const auto& signatures = Signatures::Table::getDefault();
+      for (std::size_t i = 0; i < signatures.getContainers().size(); ++i) {
+        benchmark->Args({int64_t(i), 0});
+        benchmark->Args({int64_t(i), 1});
+      }
+    });
+
+// Parses and classifies a profile of the given size in MB, on the given number
+// of threads, or on all of them for 0.
+static void getOperatorBracketLocations(benchmark::State& state) {
+  const auto& signatures = Signatures::Table::getDefault();
+  const auto& profile = getProfile(std::size_t(state.range(0)) << 20);
+  const auto jobs = state.range(1) == 0
+      ? std::max<std::size_t>(std::thread::hardware_concurrency(), 1)
+      : std::size_t(state.range(1));
+
+  std::size_t locations = 0;
+  for (auto _ : state) {
+    Profile::IngestionStatistics statistics;
+    locations = Profile::getOperatorBracketLocations(
+                    profile, signatures, jobs, statistics)
+                    .size();
+  }
+  state.SetBytesProcessed(state.iterations() * profile.size());
+  state.counters["locations"] = locations;
+}
+BENCHMARK(getOperatorBracketLocations)
+    ->ArgNames({"MB", "jobs"})
+    ->ArgsProduct({{1, 100, 1024}, {1, 0}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,160 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Parses translation units with the bodies of functions away from profiled
+// lines skipped, and matches operator[] calls in what remains. Skipped bodies
+// are neither parsed nor analyzed, which is most of the work for large
+// translation units with a handful of profiled lines.
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <clang/AST/ASTConsumer.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/FrontendAction.h>
+#include <clang/Frontend/Utils.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <propellint/Matcher.h>
+
+namespace Analysis {
+// How operator[] calls are found: with the AST matchers of Matcher.h, or the
+// single-pass visitor of Visitor.h.
+enum class Engine {
+  Matcher,
+  Visitor,
+};
+
+Engine parseEngine(std::string_view name);
+
+// Shared by all the translation units of a run.
+struct Statistics {
+  std::atomic<std::size_t> bodies = 0;
+  std::atomic<std::size_t> skippedBodies = 0;
+  std::atomic<uint64_t> matchNanoseconds = 0;
+};
+
+// Called for each operator[] call found, while its AST is alive.
+using Callback =
+    std::function<void(const clang::CXXOperatorCallExpr&, clang::ASTContext&)>;
+
+class SiteConsumer : public clang::ASTConsumer {
+ public:
+  SiteConsumer(
+      const Matcher::LineIndex& index,
+      Engine engine,
+      const clang::SourceManager& SM,
+      const clang::LangOptions& langOptions,
+      const Callback& callback,
+      Statistics& statistics)
+      : index(index),
+        engine(engine),
+        SM(SM),
+        langOptions(langOptions),
+        callback(callback),
+        statistics(statistics) {}
+
+  // Only called by Sema for bodies which may be skipped at all.
+  bool shouldSkipFunctionBody(clang::Decl* decl) override;
+
+  void HandleTranslationUnit(clang::ASTContext& context) override;
+
+ private:
+  // Finds the last line of the body following a declaration, by lexing the raw
+  // source up to its closing brace.
+  std::optional<unsigned> getBodyEndLine(const clang::Decl& decl) const;
+
+  bool isSkippable(const clang::Decl& decl);
+
+  const Matcher::LineIndex& index;
+  const Engine engine;
+  const clang::SourceManager& SM;
+  const clang::LangOptions& langOptions;
+  const Callback& callback;
+  Statistics& statistics;
+  Matcher::FileLines files;
+};
+
+class SiteAction : public clang::ASTFrontendAction {
+ public:
+  // With `dependencies`, the files entered while parsing, system headers
+  // included, are appended to it.
+  SiteAction(
+      const Matcher::LineIndex& index,
+      Engine engine,
+      Callback callback,
+      Statistics& statistics,
+      std::vector<std::string>* dependencies = nullptr)
+      : index(index),
+        engine(engine),
+        callback(std::move(callback)),
+        statistics(statistics),
+        dependencies(dependencies) {}
+
+ protected:
+  std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
+      clang::CompilerInstance& CI,
+      llvm::StringRef file) override;
+
+  void EndSourceFileAction() override;
+
+ private:
+  const Matcher::LineIndex& index;
+  const Engine engine;
+  Callback callback;
+  Statistics& statistics;
+  std::vector<std::string>* dependencies;
+  std::shared_ptr<clang::DependencyCollector> dependencyCollector;
+};
+
+// Exposes only the first compile command of each file, so that a file listed
+// several times, e.g. by variants of a library, is parsed once.
+class FirstCommandDatabase : public clang::tooling::CompilationDatabase {
+ public:
+  explicit FirstCommandDatabase(
+      const clang::tooling::CompilationDatabase& database)
+      : database(database) {}
+
+  std::vector<clang::tooling::CompileCommand> getCompileCommands(
+      llvm::StringRef file) const override;
+
+  std::vector<std::string> getAllFiles() const override {
+    return database.getAllFiles();
+  }
+
+  std::vector<clang::tooling::CompileCommand> getAllCompileCommands()
+      const override;
+
+ private:
+  const clang::tooling::CompilationDatabase& database;
+};
+
+// Creates a SiteAction per translation unit, for ClangTool::run.
+std::unique_ptr<clang::tooling::FrontendActionFactory> newSiteActionFactory(
+    const Matcher::LineIndex& index,
+    Engine engine,
+    Callback callback,
+    Statistics& statistics,
+    std::vector<std::string>* dependencies = nullptr);
+} // namespace Analysis
@@ -15,7 +15,11 @@
 #pragma once
 
 #include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <iterator>
 #include <sstream>
@@ -29,6 +33,43 @@
 #include <simdjson.h>
 
 namespace Buck {
+// Targets whose compilation database cannot be built, skipped by the batched
+// builds. Kept in a file, one target and the time it was added per line, if a
+// path is given. Targets older than `maxAge` are dropped when the file is
+// loaded, so that they are built again once they may have been fixed.
+class DenyList {
+ public:
+  explicit DenyList(
+      std::string path = "",
+      std::chrono::seconds maxAge = std::chrono::hours(24 * 7));
+
+  bool contains(const std::string& target) const {
+    return targets.contains(target);
+  }
+
+  void add(const std::string& target) {
+    targets.emplace(target, now());
+  }
+
+  std::size_t size() const {
+    return targets.size();
+  }
+
+  void save() const;
+
+ private:
+  // In seconds since the epoch.
+  static int64_t now() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+  std::string path;
+  // The time each target was added at.
+  std::unordered_map<std::string, int64_t> targets;
+};
+
 std::unordered_map<std::string, std::vector<std::string>>
 getFilenameToTargetMap(
     const std::string directory,
@@ -38,5 +79,18 @@ std::unordered_map<std::string, std::string> buildCompilationDatabases(
     const std::vector<std::string>& targets);
 std::unordered_map<std::string, std::string> buildCompilationDatabases2(
     const std::string directory,
-    const std::vector<std::string>& targets);
+    const std::vector<std::string>& targets,
+    DenyList& denyList);
+// Builds the compilation databases in batches, running up to `jobs` buck
+// commands at a time, and calls `callback` with each target and the path to
+// its database as soon as its batch is built. Failed batches are built again
+// once, then split until the targets breaking them are found, which are added
+// to the deny-list and returned. The errors of these targets are printed.
+std::vector<std::string> buildCompilationDatabasesAsync(
+    const std::string directory,
+    const std::vector<std::string>& targets,
+    std::size_t jobs,
+    DenyList& denyList,
+    const std::function<void(const std::string&, const std::string&)>&
+        callback);
 } // namespace Buck
@@ -0,0 +1,78 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// An on-disk index of what Buck reported in previous runs: the targets owning
+// each file, and the compilation database of each target. Entries are stamped
+// with the build file of their package, and the whole index with the Buck
+// configuration, so that Buck is only queried for files and targets whose
+// build file or configuration changed since.
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace BuckCache {
+// Bump whenever the format or the meaning of the entries changes.
+constexpr uint32_t kVersion = 2;
+
+class Cache {
+ public:
+  // Loads the index at `path` if it exists and matches the configuration of
+  // the source `directory`.
+  Cache(std::string path, std::string directory);
+
+  // Returns the owners of the files with a fresh entry, and adds the others
+  // to `stale`.
+  std::unordered_map<std::string, std::vector<std::string>> getOwners(
+      const std::unordered_set<std::string>& filenames,
+      std::unordered_set<std::string>& stale);
+
+  void setOwners(const std::string& filename, std::vector<std::string> targets);
+
+  // Returns nothing if the entry is stale, or if the database was removed.
+  std::optional<std::string> getDatabase(const std::string& target);
+
+  void setDatabase(const std::string& target, std::string database);
+
+  void save() const;
+
+ private:
+  // Hashes the nearest build file at or above the directory of a package,
+  // relative to the source directory.
+  uint64_t getStamp(const std::string& package);
+
+  template <typename Value>
+  struct Entry {
+    uint64_t stamp;
+    Value value;
+  };
+
+  const std::string path;
+  const std::string directory;
+  uint64_t configuration;
+  // By the directory of the package.
+  std::unordered_map<std::string, uint64_t> stamps;
+  std::unordered_map<std::string, Entry<std::vector<std::string>>> owners;
+  std::unordered_map<std::string, Entry<std::string>> databases;
+};
+
+// Returns the directory of the package of a target, e.g. "a/b" for "//a/b:c",
+// or nothing for a target of another cell.
+std::optional<std::string> getPackage(const std::string& target);
+} // namespace BuckCache
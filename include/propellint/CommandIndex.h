@@ -0,0 +1,65 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// An index of the commands of a compile_commands.json, as written by CMake,
+// Bazel or Bear. The file is memory-mapped and parsed once with simdjson, and
+// the commands of each file are then found without parsing it again.
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace CommandIndex {
+struct Command {
+  std::string directory;
+  // As written in the database, possibly relative to the directory.
+  std::string filename;
+  std::vector<std::string> arguments;
+  std::string output;
+};
+
+// Splits a command line as a POSIX shell would, without expansions.
+std::vector<std::string> splitCommand(std::string_view command);
+
+class Index {
+ public:
+  // Throws if the file cannot be read or is not a compilation database.
+  explicit Index(const std::string& path);
+
+  Index(const Index&) = delete;
+
+  // Returns the commands of an absolute filename, in the order of the
+  // database.
+  std::vector<const Command*> find(const std::string& filename) const;
+
+  const std::vector<Command>& getCommands() const {
+    return commands;
+  }
+
+  // The absolute filenames of the commands.
+  std::vector<std::string> getFilenames() const;
+
+ private:
+  std::vector<Command> commands;
+  // By absolute, normalized filename.
+  std::unordered_map<std::string, std::vector<std::size_t>> files;
+};
+
+// Returns the absolute, normalized filename of a command.
+std::string getAbsoluteFilename(const Command& command);
+} // namespace CommandIndex
@@ -0,0 +1,134 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Where compile commands come from. A provider finds the targets owning the
+// profiled files, and a compilation database for each of these targets, from
+// Buck or from a single compile_commands.json.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <clang/Tooling/CompilationDatabase.h>
+
+#include <propellint/Buck.h>
+#include <propellint/BuckCache.h>
+#include <propellint/CommandIndex.h>
+
+namespace Commands {
+// Loads a compilation database, or returns nothing and sets the error.
+using Loader =
+    std::function<std::unique_ptr<clang::tooling::CompilationDatabase>(
+        std::string& error)>;
+
+// Called with each target, the loader of its database, and the cost of
+// loading it.
+using Callback = std::function<void(const std::string&, Loader, uint64_t)>;
+
+class Provider {
+ public:
+  virtual ~Provider() = default;
+
+  // Returns the targets owning each of the files, which are relative to the
+  // source directory. Files without owner are left out.
+  virtual std::unordered_map<std::string, std::vector<std::string>> getOwners(
+      const std::unordered_set<std::string>& filenames) = 0;
+
+  // Calls `callback` on the calling thread for each target, as soon as its
+  // database can be loaded. Loaders can be called from any thread. Returns the
+  // targets without a database.
+  virtual std::vector<std::string> getDatabases(
+      const std::vector<std::string>& targets,
+      const Callback& callback) = 0;
+};
+
+struct BuckOptions {
+  // The number of buck commands run at a time.
+  std::size_t jobs = 4;
+  // See Buck::DenyList, not saved if empty.
+  std::string denyListPath;
+  // See BuckCache::Cache, not used if empty.
+  std::string cachePath;
+};
+
+class BuckProvider : public Provider {
+ public:
+  BuckProvider(std::string directory, const BuckOptions& options);
+
+  std::unordered_map<std::string, std::vector<std::string>> getOwners(
+      const std::unordered_set<std::string>& filenames) override;
+
+  std::vector<std::string> getDatabases(
+      const std::vector<std::string>& targets,
+      const Callback& callback) override;
+
+ private:
+  const std::string directory;
+  const std::size_t jobs;
+  Buck::DenyList denyList;
+  std::optional<BuckCache::Cache> cache;
+};
+
+// Serves the files of a compile_commands.json, as written by CMake, Bazel or
+// Bear, as a single target named after it.
+class JsonProvider : public Provider {
+ public:
+  // Throws if the database cannot be read.
+  JsonProvider(std::string directory, const std::string& path);
+
+  std::unordered_map<std::string, std::vector<std::string>> getOwners(
+      const std::unordered_set<std::string>& filenames) override;
+
+  std::vector<std::string> getDatabases(
+      const std::vector<std::string>& targets,
+      const Callback& callback) override;
+
+ private:
+  const std::string directory;
+  const std::string target;
+  const std::shared_ptr<const CommandIndex::Index> index;
+};
+
+// A compilation database over an index, which can be shared by several.
+class IndexDatabase : public clang::tooling::CompilationDatabase {
+ public:
+  explicit IndexDatabase(std::shared_ptr<const CommandIndex::Index> index)
+      : index(std::move(index)) {}
+
+  std::vector<clang::tooling::CompileCommand> getCompileCommands(
+      llvm::StringRef FilePath) const override;
+
+  std::vector<std::string> getAllFiles() const override;
+
+  std::vector<clang::tooling::CompileCommand> getAllCompileCommands()
+      const override;
+
+ private:
+  const std::shared_ptr<const CommandIndex::Index> index;
+};
+
+// Loads a compilation database file through an index, which is faster than
+// clang::tooling::JSONCompilationDatabase for large databases.
+std::unique_ptr<clang::tooling::CompilationDatabase> loadDatabase(
+    const std::string& path,
+    std::string& error);
+} // namespace Commands
@@ -0,0 +1,97 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// A cache of the file system shared by all the threads, so that the headers
+// included by most translation units are stat'ed and read once per run rather
+// than once per file. Failed lookups are cached too, since header search
+// probes many paths which do not exist. The headers are expected not to change
+// during a run. Main files, which are read once, and precompiled headers,
+// which are written during a run, are not cached.
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/Support/ErrorOr.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+namespace FileCache {
+struct Statistics {
+  std::atomic<std::size_t> hits = 0;
+  std::atomic<std::size_t> misses = 0;
+};
+
+// Keyed by absolute path, without . components. Thread-safe.
+class Cache {
+ public:
+  // Buffers are no longer added once they take `maxBufferBytes`.
+  explicit Cache(std::size_t maxBufferBytes = std::size_t(1) << 30)
+      : maxBufferBytes(maxBufferBytes) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status(
+      const std::string& path,
+      llvm::vfs::FileSystem& fs);
+
+  // Buffers are memory-mapped when large enough, and shared by all readers.
+  llvm::ErrorOr<std::shared_ptr<llvm::MemoryBuffer>> getBuffer(
+      const std::string& path,
+      llvm::vfs::FileSystem& fs);
+
+  llvm::ErrorOr<std::vector<llvm::vfs::directory_entry>> listDirectory(
+      const std::string& path,
+      llvm::vfs::FileSystem& fs);
+
+  const Statistics& getStatistics() const {
+    return statistics;
+  }
+
+ private:
+  // Returns the value for the key, computing it outside of the lock if
+  // missing. Two threads may compute it, and the first one is kept. A value
+  // is only kept if `keep` returns true, called with the lock held.
+  template <typename T, typename F, typename K>
+  T get(
+      std::unordered_map<std::string, T>& map,
+      const std::string& key,
+      F compute,
+      K keep);
+
+  const std::size_t maxBufferBytes;
+  std::shared_mutex mutex;
+  // The size of the buffers, guarded by the mutex.
+  std::size_t bufferBytes = 0;
+  std::unordered_map<std::string, llvm::ErrorOr<llvm::vfs::Status>> statuses;
+  std::unordered_map<
+      std::string,
+      llvm::ErrorOr<std::shared_ptr<llvm::MemoryBuffer>>>
+      buffers;
+  std::unordered_map<
+      std::string,
+      llvm::ErrorOr<std::vector<llvm::vfs::directory_entry>>>
+      directories;
+  Statistics statistics;
+};
+
+// Creates a file system reading through the cache. Each ClangTool needs its
+// own, since it sets the working directory.
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> newFileSystem(Cache& cache);
+} // namespace FileCache
@@ -0,0 +1,71 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Readers for the profile formats other than the JSON one described in
+// Profile.h. Each reader streams its input and folds its samples, so that all
+// formats share the classification of Profile::getOperatorBracketLocations.
+//
+// - Folded stacks: "root;...;leaf weight" lines, as produced by
+//   stackcollapse scripts. Frames may be "function@filename:line".
+// - perf script: samples separated by blank lines, with one "address symbol
+//   (dso)" line per frame, leaf first, optionally followed by a
+//   "filename:line" line (perf script -F +srcline). The sample weight is its
+//   period if printed, 1 otherwise.
+// - pprof: a (gzipped) profile.proto. The last sample value is the weight.
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include <propellint/Profile.h>
+#include <propellint/Signatures.h>
+
+namespace Formats {
+enum class Format {
+  Json,
+  Folded,
+  PerfScript,
+  Pprof,
+};
+
+Format parse(std::string_view name);
+
+// Detects the format from the first bytes of the file.
+Format detect(const std::string& filename);
+
+Profile::FoldedStacks readFolded(
+    const std::string& filename,
+    Profile::IngestionStatistics& statistics);
+
+Profile::FoldedStacks readPerfScript(
+    const std::string& filename,
+    Profile::IngestionStatistics& statistics);
+
+Profile::FoldedStacks readPprof(
+    const std::string& filename,
+    Profile::IngestionStatistics& statistics);
+
+// Reads a profile in any format. `jobs`, `windowSize` and `normalizeFrames`
+// only apply to JSON.
+Profile::FoldedStacks getFoldedStacks(
+    const std::string& filename,
+    Format format,
+    const Signatures::Table& signatures,
+    std::size_t jobs,
+    std::size_t windowSize,
+    Profile::IngestionStatistics& statistics,
+    bool normalizeFrames = false);
+} // namespace Formats
@@ -0,0 +1,25 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// A fast non-cryptographic hash of bytes, shared by the on-disk caches.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Hash {
+// Hashes `size` bytes. The hash is stable across runs, so it can be saved.
+uint64_t hash(const char* data, std::size_t size, uint64_t seed);
+} // namespace Hash
@@ -0,0 +1,76 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// An index of the translation units including each profiled header, so that a
+// header is analyzed once, through the translation unit including it which is
+// the cheapest to parse. Translation units are scanned with the preprocessor
+// only, and their cost is the number of bytes they preprocess.
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <clang/Tooling/CompilationDatabase.h>
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+namespace Includes {
+bool isHeader(std::string_view filename);
+
+struct Includer {
+  std::string target;
+  // Relative to the source directory, as profiled files.
+  std::string filename;
+  uint64_t cost;
+};
+
+class Index {
+ public:
+  // Headers are relative to the source directory.
+  Index(
+      const std::string& directory,
+      std::unordered_set<std::string> headers);
+
+  // Preprocesses the given files of the compilation database of a target.
+  // Can be called from several threads.
+  void scan(
+      const std::string& target,
+      const clang::tooling::CompilationDatabase& database,
+      const std::vector<std::string>& files,
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fileSystem =
+          llvm::vfs::getRealFileSystem());
+
+  std::optional<Includer> find(const std::string& header) const;
+
+  std::size_t size() const {
+    return includers.size();
+  }
+
+ private:
+  void add(const std::string& header, const Includer& includer);
+
+  std::string directory;
+  const std::unordered_set<std::string> headers;
+  mutable std::mutex mutex;
+  // The cheapest includer of each header.
+  std::unordered_map<std::string, Includer> includers;
+};
+} // namespace Includes
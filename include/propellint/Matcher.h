@@ -14,7 +14,17 @@
 
 #pragma once
 
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <clang/AST/DeclTemplate.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
 #include <clang/ASTMatchers/ASTMatchers.h>
+#include <clang/Basic/SourceManager.h>
+
+#include <llvm/ADT/DenseMap.h>
 
 using namespace clang::ast_matchers;
 
@@ -45,15 +55,128 @@ auto isPartOfIncrementOrDecrementExpr() {
 } // namespace
 
 namespace Matcher {
+inline auto getOperatorBracket() {
+  return cxxOperatorCallExpr(
+      cxxOperatorCallExpr().bind("bracket"),
+      hasOverloadedOperatorName("[]"),
+      unless(anyOf(
+          isReferenceRightSideOfVarDecl(),
+          isLHSOfAssignment(),
+          isPartOfIncrementOrDecrementExpr())));
+}
+
 const auto get() {
+  return traverse(clang::TK_IgnoreUnlessSpelledInSource, getOperatorBracket());
+}
+
+// Same as get(), but matched within a function.
+inline auto getInFunction() {
   return traverse(
       clang::TK_IgnoreUnlessSpelledInSource,
-      cxxOperatorCallExpr(
-          cxxOperatorCallExpr().bind("bracket"),
-          hasOverloadedOperatorName("[]"),
-          unless(anyOf(
-              isReferenceRightSideOfVarDecl(),
-              isLHSOfAssignment(),
-              isPartOfIncrementOrDecrementExpr()))));
+      functionDecl(forEachDescendant(getOperatorBracket())));
+}
+
+// Sorted lines of the profiled call sites, per filename.
+using LineIndex = std::unordered_map<std::string, std::vector<unsigned>>;
+
+// Indexed lines of the file of each FileID, looked up once per file.
+using FileLines = llvm::DenseMap<clang::FileID, const std::vector<unsigned>*>;
+
+inline bool coversIndexedLine(
+    const clang::FunctionDecl& function,
+    const LineIndex& index,
+    const clang::SourceManager& SM,
+    FileLines& files) {
+  const auto range = SM.getExpansionRange(function.getSourceRange());
+  const auto begin = SM.getPresumedLoc(range.getBegin());
+  const auto end = SM.getPresumedLoc(range.getEnd());
+  if (begin.isInvalid() || end.isInvalid()) {
+    return false;
+  }
+
+  const auto [it, inserted] =
+      files.try_emplace(SM.getFileID(range.getBegin()), nullptr);
+  if (inserted) {
+    const auto lines = index.find(begin.getFilename());
+    if (lines != index.end()) {
+      it->second = &lines->second;
+    }
+  }
+  if (it->second == nullptr) {
+    return false;
+  }
+
+  const auto& lines = *it->second;
+  const auto line =
+      std::lower_bound(lines.begin(), lines.end(), begin.getLine());
+  return line != lines.end() && *line <= end.getLine();
+}
+
+// Collects the function definitions spelled in the source which cover an
+// indexed line. Functions are not searched for nested functions, since their
+// bodies are matched as a whole.
+inline void collectFunctions(
+    const clang::DeclContext& context,
+    const LineIndex& index,
+    const clang::SourceManager& SM,
+    FileLines& files,
+    std::vector<const clang::FunctionDecl*>& functions) {
+  for (const clang::Decl* decl : context.decls()) {
+    if (decl->isImplicit()) {
+      continue;
+    }
+    if (const auto* specialization =
+            llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(decl);
+        specialization != nullptr &&
+        specialization->getSpecializationKind() !=
+            clang::TSK_ExplicitSpecialization) {
+      continue;
+    }
+    if (const auto* templateDecl = llvm::dyn_cast<clang::TemplateDecl>(decl)) {
+      decl = templateDecl->getTemplatedDecl();
+      if (decl == nullptr) {
+        continue;
+      }
+    }
+
+    if (const auto* function = llvm::dyn_cast<clang::FunctionDecl>(decl)) {
+      if (function->doesThisDeclarationHaveABody() &&
+          coversIndexedLine(*function, index, SM, files)) {
+        functions.push_back(function);
+      }
+    } else if (const auto* nested = llvm::dyn_cast<clang::DeclContext>(decl)) {
+      collectFunctions(*nested, index, SM, files, functions);
+    }
+  }
+}
+
+inline std::vector<const clang::FunctionDecl*> findFunctions(
+    const LineIndex& index,
+    clang::ASTContext& context) {
+  std::vector<const clang::FunctionDecl*> functions;
+  FileLines files;
+  collectFunctions(
+      *context.getTranslationUnitDecl(),
+      index,
+      context.getSourceManager(),
+      files,
+      functions);
+  return functions;
+}
+
+// Matches get() only within the functions covering an indexed line. Most of a
+// translation unit comes from headers without any profiled line, and is never
+// matched.
+inline std::vector<BoundNodes> matchSites(
+    const LineIndex& index,
+    clang::ASTContext& context) {
+  const auto matcher = getInFunction();
+  std::vector<BoundNodes> matches;
+  for (const auto* function : findFunctions(index, context)) {
+    const auto functionMatches = match(matcher, *function, context);
+    matches.insert(
+        matches.end(), functionMatches.begin(), functionMatches.end());
+  }
+  return matches;
 }
 } // namespace Matcher
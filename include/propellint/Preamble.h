@@ -0,0 +1,62 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Precompiles the #include directives which the files sharing a compile
+// command all start with, so that these headers are parsed once per group of
+// files instead of once per file. Files keep their own #include directives,
+// which are skipped once the precompiled headers are loaded, as long as the
+// headers have include guards or #pragma once.
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <clang/Tooling/CompilationDatabase.h>
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+namespace Preamble {
+// Returns the #include directives at the start of `code`, in order, up to any
+// other directive or code. Blank lines and comments are skipped. Since the
+// precompiled directives are loaded before anything else, only those which
+// the files start with exactly can be precompiled.
+std::vector<std::string> getIncludes(std::string_view code);
+
+// Returns the directives which all the lists start with.
+std::vector<std::string> getCommonPrefix(
+    const std::vector<std::vector<std::string>>& includes);
+
+// Files with the same key are compiled with the same arguments, output and
+// dependency files aside, from the same directory, and quoted includes are
+// looked up in the same directory.
+std::string getGroupKey(const clang::tooling::CompileCommand& command);
+
+// Returns a hash of the key of a group and its precompiled directives, which
+// identifies the precompiled header across runs.
+uint64_t hash(
+    std::string_view groupKey,
+    const std::vector<std::string>& includes);
+
+// Writes the directives to `output` followed by ".h", and precompiles them to
+// `output` with the arguments of `command`. Returns whether it succeeded.
+bool build(
+    const clang::tooling::CompileCommand& command,
+    const std::vector<std::string>& includes,
+    const std::string& output,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fileSystem =
+        llvm::vfs::getRealFileSystem());
+} // namespace Preamble
@@ -17,8 +17,14 @@
 // A utility header to process a profile.
 // This tool requires a profile following the following JSON structure:
 // [{stack: ["function@filename:line", ...], total_weight: number}, ...]
+// Newline-delimited records are accepted as well.
 
 #include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
 #include <string_view>
 #include <unordered_map>
 #include <unordered_set>
@@ -29,6 +35,8 @@
 
 #include <simdjson.h>
 
+#include <propellint/Signatures.h>
+
 namespace json = simdjson;
 
 namespace Profile {
@@ -52,18 +60,245 @@ struct StackEntry {
 
 using CallSite = std::pair<std::string_view, int>;
 
-// Extracts all operator[] locations and their weight from a JSON profile.
+// Counters of the parallel ingestion. Records without any known operator[]
+// frame are skipped by a prefilter on their raw bytes, before being parsed.
+struct IngestionStatistics {
+  std::size_t records = 0;
+  std::size_t skippedRecords = 0;
+  std::size_t scannedBytes = 0;
+  // Summed over all threads.
+  double scanSeconds = 0;
+  std::size_t uniqueStacks = 0;
+};
+
+// Maps each distinct string to a dense 32-bit identifier, so that hot loops
+// hash and compare integers instead of strings. The table owns its strings:
+// views returned by it stay valid as long as the table does, even if moved.
+class SymbolTable {
+ public:
+  uint32_t intern(std::string_view symbol);
+
+  // Interns a symbol without copying it, e.g. from a mapped file. `storage`
+  // keeps the symbol alive as long as the table.
+  uint32_t adopt(
+      std::string_view symbol,
+      const std::shared_ptr<const void>& storage);
+
+  std::optional<uint32_t> find(std::string_view symbol) const;
+
+  std::string_view operator[](uint32_t id) const {
+    return symbols[id];
+  }
+
+  std::size_t size() const {
+    return symbols.size();
+  }
+
+ private:
+  static constexpr std::size_t kBlockSize = 64 * 1024;
+
+  std::vector<std::unique_ptr<char[]>> blocks;
+  std::size_t blockOffset = kBlockSize;
+  std::vector<std::shared_ptr<const void>> storages;
+  std::vector<std::string_view> symbols;
+  std::unordered_map<std::string_view, uint32_t> ids;
+};
+
+struct Frame {
+  uint32_t function;
+  uint32_t filename;
+  int line;
+};
+
+// Identical stacks folded together: each distinct stack is stored once, as an
+// array of interned frames (root first), with the summed weight of its
+// samples. Stack-level analyses can run once per distinct stack on this table
+// instead of going back to the profile.
+class FoldedStacks {
+ public:
+  // Interns a "function@filename:line" frame.
+  uint32_t getFrameId(std::string_view entry);
+
+  uint32_t
+  getFrameId(std::string_view function, std::string_view filename, int line);
+
+  void add(std::span<const uint32_t> stack, uint64_t weight);
+
+  void merge(const FoldedStacks& other);
+
+  std::size_t size() const {
+    return weights.size();
+  }
+
+  std::span<const uint32_t> getStack(uint32_t id) const {
+    return {
+        stackFrames.data() + stackOffsets[id],
+        stackFrames.data() + stackOffsets[id + 1]};
+  }
+
+  uint64_t getWeight(uint32_t id) const {
+    return weights[id];
+  }
+
+  const Frame& getFrame(uint32_t id) const {
+    return frames[id];
+  }
+
+  std::size_t getFrameCount() const {
+    return frames.size();
+  }
+
+  const SymbolTable& getFunctions() const {
+    return functions;
+  }
+
+  const SymbolTable& getFilenames() const {
+    return filenames;
+  }
+
+ private:
+  static uint64_t hash(std::span<const uint32_t> stack);
+
+  void grow();
+
+  std::string scratch;
+  SymbolTable entries;
+  SymbolTable functions;
+  SymbolTable filenames;
+  std::vector<Frame> frames;
+
+  std::vector<uint32_t> stackFrames;
+  std::vector<std::size_t> stackOffsets = {0};
+  std::vector<uint64_t> hashes;
+  std::vector<uint64_t> weights;
+  // Open addressing over stack identifiers plus one, zero being empty.
+  std::vector<uint32_t> slots;
+};
+
+// Dense table of the weights of each call site. Call sites are numbered in
+// insertion order, and their filenames are interned.
+class Locations {
+ public:
+  using Weights = std::pair<uint64_t, uint64_t>;
+
+  void add(uint32_t filename, int line, const Weights& weights);
+
+  void add(const CallSite& site, const Weights& weights) {
+    add(filenames.intern(site.first), site.second, weights);
+  }
+
+  void merge(const Locations& other);
+
+  const Weights* find(const CallSite& site) const;
+
+  const Weights& at(const CallSite& site) const;
+
+  CallSite getCallSite(uint32_t id) const {
+    return {filenames[sites[id].first], sites[id].second};
+  }
+
+  const Weights& getWeights(uint32_t id) const {
+    return weights[id];
+  }
+
+  std::vector<CallSite> getCallSites() const;
+
+  void reserve(std::size_t size);
+
+  std::size_t size() const {
+    return sites.size();
+  }
+
+  bool empty() const {
+    return sites.empty();
+  }
+
+  SymbolTable& getFilenames() {
+    return filenames;
+  }
+
+  const SymbolTable& getFilenames() const {
+    return filenames;
+  }
+
+ private:
+  static uint64_t getKey(uint32_t filename, int line) {
+    return uint64_t(filename) << 32 | uint32_t(line);
+  }
+
+  SymbolTable filenames;
+  std::vector<std::pair<uint32_t, int>> sites;
+  std::vector<Weights> weights;
+  std::unordered_map<uint64_t, uint32_t> index;
+};
+
+// Folds the stacks of a JSON profile. The profile is split into record-aligned
+// chunks which are parsed on `jobs` threads. Only stacks with a known
+// operator[] frame are kept, or with `normalizeFrames`, stacks with a frame
+// which is a known operator[] once normalized. Frames are not normalized here.
+FoldedStacks getFoldedStacks(
+    const json::padded_string& json,
+    const Signatures::Table& signatures,
+    std::size_t jobs,
+    IngestionStatistics& statistics,
+    bool normalizeFrames = false);
+
+// Same as above, but streams the profile from a file in windows of
+// `windowSize` bytes (larger if a single record does not fit), so that only
+// one window is resident at a time.
+FoldedStacks getFoldedStacks(
+    const std::string& filename,
+    const Signatures::Table& signatures,
+    std::size_t jobs,
+    std::size_t windowSize,
+    IngestionStatistics& statistics,
+    bool normalizeFrames = false);
+
+// Reduces a raw demangled symbol to the form used by signatures, e.g.
+// "std::map<int, int>::operator[](int const&) [clone .isra.0]" to
+// "std::map::operator[]": template arguments, parameters, qualifiers, return
+// types, ABI tags and clone or inlining suffixes are removed.
+std::string normalizeFunction(std::string_view function);
+
+// Splits a frame of the profile into its function, filename and line.
+StackEntry parseProfileEntry(std::string_view entry);
+
+// Returns whether the operator[] at `index`, the first one of the stack, is
+// followed by an insert frame of its container. Frames are identifiers into
+// `frameSignatures`.
+bool isInsertStack(
+    const std::vector<uint32_t>& stack,
+    std::size_t index,
+    const std::vector<Signatures::Frame>& frameSignatures,
+    const Signatures::Table& signatures);
+
+// Returns the stacks with normalized functions, folding the stacks which become
+// identical. Each distinct function is normalized once, however many frames
+// and samples reference it.
+FoldedStacks normalizeFrames(const FoldedStacks& stacks);
+
+// Extracts all operator[] locations and their weight from folded stacks.
 // This returns two weights: a lower bound on the relative time spent inserting,
-// and the total weight.
-std::unordered_map<Profile::CallSite, std::pair<uint64_t, uint64_t>>
-getOperatorBracketLocations(
-    json::ondemand::parser& parser,
-    const json::padded_string& json);
-
-std::unordered_map<CallSite, std::pair<uint64_t, uint64_t>>
-getInsertOperatorBracketLocations(
-    json::ondemand::parser& parser,
-    const json::padded_string& json);
+// and the total weight. Each distinct stack is classified once.
+Locations getOperatorBracketLocations(
+    const FoldedStacks& stacks,
+    const Signatures::Table& signatures);
+
+// Same as above, from a JSON profile.
+Locations getOperatorBracketLocations(
+    const json::padded_string& json,
+    const Signatures::Table& signatures,
+    std::size_t jobs,
+    IngestionStatistics& statistics);
+
+// We are not interested in operator[] calls that never insert.
+Locations getInsertOperatorBracketLocations(const Locations& locations);
+
+Locations getInsertOperatorBracketLocations(
+    const json::padded_string& json,
+    const Signatures::Table& signatures,
+    std::size_t jobs,
+    IngestionStatistics& statistics);
 } // namespace Profile
 
 namespace std {
@@ -0,0 +1,63 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// A binary cache of the result of parsing a profile, so that repeated runs on
+// the same profile skip JSON entirely. The file is columnar: interned strings
+// are stored once, followed by one array per field. It is memory-mapped when
+// read, and is only used if it matches the source profile (size, modification
+// time and content hash), the version of the signature table and whether
+// frames were normalized.
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include <propellint/Profile.h>
+#include <propellint/Signatures.h>
+
+namespace ProfileCache {
+struct Source {
+  uint64_t size;
+  int64_t mtime;
+  uint64_t hash;
+  // Set by the caller, since it changes the parsed result.
+  bool normalizedFrames = false;
+};
+
+struct Content {
+  // The filenames of the locations are views into the mapped cache, which they
+  // keep mapped.
+  Profile::Locations locations;
+  std::optional<Profile::FoldedStacks> stacks;
+};
+
+// Hashes the profile on `jobs` threads.
+Source getSource(const std::string& filename, std::size_t jobs);
+
+// Returns nothing if the cache does not exist, is corrupted or stale.
+std::optional<Content> load(
+    const std::string& filename,
+    const Source& source,
+    const Signatures::Table& signatures);
+
+// Stacks are optional, and only needed by stack-level analyses.
+void save(
+    const std::string& filename,
+    const Source& source,
+    const Signatures::Table& signatures,
+    const Profile::Locations& locations,
+    const Profile::FoldedStacks* stacks);
+} // namespace ProfileCache
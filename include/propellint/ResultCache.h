@@ -0,0 +1,87 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// An on-disk cache of what matching found in each translation unit, so that
+// files which did not change are not parsed again by later runs. An entry is
+// keyed by the contents of the main file, its compile command and the engine,
+// and records the hashes of all the files it included, which are checked when
+// it is loaded. Since only profiled lines are matched, an entry records the
+// lines which were checked and whether a call was reported on each.
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ResultCache {
+// Bump whenever what is reported for a line changes.
+constexpr uint32_t kVersion = 1;
+
+struct Line {
+  std::string filename;
+  unsigned line;
+  bool matched;
+
+  bool operator==(const Line&) const = default;
+};
+
+struct Entry {
+  // Absolute filenames, with the hashes of their contents.
+  std::vector<std::pair<std::string, uint64_t>> dependencies;
+  std::vector<Line> lines;
+};
+
+// Entries are stored one per file in a directory, so that they can be read
+// and written concurrently.
+class Cache {
+ public:
+  explicit Cache(const std::string& directory);
+
+  // Returns nothing if the file cannot be read.
+  std::optional<uint64_t> getKey(
+      const std::string& filename,
+      const std::string& workingDirectory,
+      const std::vector<std::string>& commandLine,
+      std::string_view engine);
+
+  // Returns nothing if there is no entry, or if one of its dependencies
+  // changed.
+  std::optional<Entry> load(uint64_t key);
+
+  // Dependencies are relative to `workingDirectory` unless absolute. Nothing is
+  // saved if one of them cannot be read.
+  void save(
+      uint64_t key,
+      const std::string& workingDirectory,
+      const std::vector<std::string>& dependencies,
+      const std::vector<Line>& lines);
+
+ private:
+  // Files are expected not to change during a run, so their hashes are
+  // computed once.
+  std::optional<uint64_t> hashFile(const std::string& filename);
+
+  std::string getPath(uint64_t key) const;
+
+  const std::string directory;
+  std::mutex mutex;
+  std::unordered_map<std::string, std::optional<uint64_t>> hashes;
+};
+} // namespace ResultCache
@@ -0,0 +1,89 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Runs independent tasks of very different costs on a pool of workers. Tasks
+// are dealt to per-worker queues largest first, and a worker whose queue is
+// empty steals from the longest other queue, so that a few expensive tasks do
+// not leave the other workers idle. Tasks can be held back while the process
+// is close to a memory budget.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Scheduler {
+struct Task {
+  std::size_t id;
+  // Only compared with the cost of other tasks.
+  uint64_t cost;
+};
+
+struct WorkerStatistics {
+  std::size_t tasks = 0;
+  std::size_t stolenTasks = 0;
+  double busySeconds = 0;
+  // Time spent waiting for memory to start a task.
+  double waitingSeconds = 0;
+};
+
+struct Statistics {
+  double wallSeconds = 0;
+  std::vector<WorkerStatistics> workers;
+};
+
+// Returns the resident set size of the process in bytes, or 0 if unknown.
+uint64_t getResidentBytes();
+
+// Returns the largest resident set size of the process so far in bytes.
+uint64_t getPeakResidentBytes();
+
+// Calls `function` with the identifier of each task added, on `jobs` threads,
+// until finished. With a non-zero `maxMemory` in bytes, tasks only start while
+// the resident set size and the growth expected from the running tasks stay
+// below it, or when no other task is running.
+class Pool {
+ public:
+  Pool(
+      std::size_t jobs,
+      std::function<void(std::size_t)> function,
+      uint64_t maxMemory = 0);
+
+  Pool(const Pool&) = delete;
+
+  ~Pool();
+
+  // Tasks are dealt to the queues, each of which is kept sorted largest first,
+  // so that a large task added late runs before the small ones already queued.
+  // Can be called while tasks run, including from the tasks themselves.
+  void add(std::vector<Task> tasks);
+
+  // Waits for all the tasks to run, and stops the workers.
+  Statistics finish();
+
+ private:
+  struct State;
+  std::unique_ptr<State> state;
+};
+
+// Runs a fixed set of tasks with a Pool.
+Statistics run(
+    std::vector<Task> tasks,
+    std::size_t jobs,
+    const std::function<void(std::size_t)>& function,
+    uint64_t maxMemory = 0);
+} // namespace Scheduler
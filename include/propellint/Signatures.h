@@ -0,0 +1,105 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// The table of container signatures used to classify profile stacks.
+// A container is identified by its operator[] frame, and a stack is an insert
+// stack if a frame below operator[] is one of the container's insert frames.
+// Transparent frames (e.g. thrift field_ref::operator[]) are ignored.
+//
+// Custom tables can be loaded from a JSON file with the following structure:
+// {
+//   "containers": [
+//     {"operator": "function", "inserts": ["function", ...]},
+//     ...
+//   ],
+//   "transparent": ["function", ...]
+// }
+// Profiles are prefiltered on "operator[]", so the operator of each container
+// must end with it.
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Signatures {
+enum class Kind : uint8_t {
+  None,
+  OperatorBracket,
+  Insert,
+  Transparent,
+};
+
+struct Frame {
+  Kind kind = Kind::None;
+  // Index of the container, for operator[] frames.
+  uint32_t container = 0;
+  // Bit set of the containers an insert frame belongs to.
+  uint64_t containers = 0;
+};
+
+struct Container {
+  std::string operatorBracket;
+  std::vector<std::string> inserts;
+};
+
+class Table {
+ public:
+  Table(
+      std::vector<Container> containers,
+      std::vector<std::string> transparent);
+  // Slots are views into the containers' strings.
+  Table(const Table&) = delete;
+  Table(Table&&) = default;
+
+  // The containers known to work with our profiles.
+  static const Table& getDefault();
+
+  static Table load(const std::string& filename);
+
+  // Does not allocate.
+  Frame find(std::string_view function) const noexcept;
+
+  bool isInsert(const Frame& operatorBracket, const Frame& frame)
+      const noexcept {
+    return frame.kind == Kind::Insert &&
+        (frame.containers & (uint64_t(1) << operatorBracket.container)) != 0;
+  }
+
+  const std::vector<Container>& getContainers() const noexcept {
+    return containers;
+  }
+
+  // Changes whenever the content of the table does.
+  uint64_t getVersion() const noexcept {
+    return version;
+  }
+
+ private:
+  struct Slot {
+    std::string_view function;
+    Frame frame;
+  };
+
+  void insert(std::string_view function, const Frame& frame);
+
+  std::vector<Container> containers;
+  std::vector<std::string> transparent;
+  // Open addressing, with a power of two size.
+  std::vector<Slot> slots;
+  uint64_t version;
+};
+} // namespace Signatures
@@ -0,0 +1,39 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Runs shell commands concurrently, reading their output as it arrives.
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Subprocess {
+struct Result {
+  // As returned by waitpid, or -1 if the command could not be started.
+  int status;
+  std::string output;
+};
+
+// Runs the commands, at most `jobs` at a time, and calls `callback` on the
+// calling thread with the index and the result of each command as soon as it
+// exits. Standard output is read in large chunks while the commands run, so
+// that they never block on a full pipe.
+void run(
+    const std::vector<std::string>& commands,
+    std::size_t jobs,
+    const std::function<void(std::size_t, Result)>& callback);
+} // namespace Subprocess
@@ -0,0 +1,63 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Scoped timers and counters, written as a Chrome trace-event file which
+// chrome://tracing and Perfetto open. Spans are recorded on a track per
+// thread, so the workers of the scheduler and of OpenMP show side by side.
+// Nothing is recorded unless tracing was started.
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace Trace {
+// Starts recording, until `stop` writes the events to `path`.
+void start(const std::string& path);
+
+// Returns false if the events could not be written.
+bool stop();
+
+bool isEnabled();
+
+// Names the track of the calling thread.
+void setThreadName(std::string_view name);
+
+// Records the value of a counter, e.g. the resident memory, over time.
+void counter(std::string_view name, int64_t value);
+
+// Records the time from its construction to its destruction.
+class Span {
+ public:
+  explicit Span(std::string_view name, std::string_view category = "phase");
+
+  Span(const Span&) = delete;
+
+  ~Span();
+
+  // Shown with the span, e.g. the file it processed.
+  void addArgument(std::string_view key, int64_t value);
+  void addArgument(std::string_view key, std::string_view value);
+
+ private:
+  const bool enabled;
+  std::string name;
+  std::string category;
+  // A JSON object, without its braces.
+  std::string arguments;
+  std::chrono::steady_clock::time_point start;
+};
+} // namespace Trace
@@ -0,0 +1,120 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// A single-pass alternative to the matcher of Matcher.h, finding the same
+// operator[] calls. Instead of walking up the parent map from each call, the
+// context of each node is derived from its parent's on a stack while walking
+// down, so each node is visited once and no parent map is built.
+
+#include <vector>
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/ExprCXX.h>
+#include <clang/AST/RecursiveASTVisitor.h>
+
+namespace Visitor {
+class OperatorBracketVisitor
+    : public clang::RecursiveASTVisitor<OperatorBracketVisitor> {
+ public:
+  // Everything within the initializer of a reference is ignored, as for
+  // isReferenceRightSideOfVarDecl().
+  bool TraverseDecl(clang::Decl* decl) {
+    const auto* var = llvm::dyn_cast_or_null<clang::VarDecl>(decl);
+    if (var == nullptr ||
+        !llvm::isa<clang::LValueReferenceType>(var->getType().getTypePtr())) {
+      return RecursiveASTVisitor::TraverseDecl(decl);
+    }
+
+    contexts.push_back({nullptr, true});
+    const auto result = RecursiveASTVisitor::TraverseDecl(decl);
+    contexts.pop_back();
+    return result;
+  }
+
+  // Called before the children of each statement, and after them below.
+  bool dataTraverseStmtPre(clang::Stmt* stmt) {
+    const auto& parent = contexts.back();
+    auto ignored = parent.ignored || isAssignedTo(parent.stmt, stmt);
+
+    const auto* call = llvm::dyn_cast<clang::CXXOperatorCallExpr>(stmt);
+    if (!ignored && call != nullptr &&
+        call->getOperator() == clang::OO_Subscript) {
+      brackets.push_back(call);
+    }
+
+    ignored = ignored || isIncrementOrDecrement(stmt);
+    contexts.push_back({stmt, ignored});
+    return true;
+  }
+
+  bool dataTraverseStmtPost(clang::Stmt* /* stmt */) {
+    contexts.pop_back();
+    return true;
+  }
+
+  const std::vector<const clang::CXXOperatorCallExpr*>& getBrackets() const {
+    return brackets;
+  }
+
+ private:
+  struct Context {
+    const clang::Stmt* stmt;
+    // Whether operator[] calls below are not reported.
+    bool ignored;
+  };
+
+  // As for isLHSOfAssignment(), the whole left-hand side is ignored.
+  static bool isAssignedTo(const clang::Stmt* parent, const clang::Stmt* stmt) {
+    if (const auto* op =
+            llvm::dyn_cast_or_null<clang::BinaryOperator>(parent)) {
+      return op->isAssignmentOp() && op->getLHS() == stmt;
+    }
+    if (const auto* call =
+            llvm::dyn_cast_or_null<clang::CXXOperatorCallExpr>(parent)) {
+      return call->isAssignmentOp() && call->getNumArgs() != 0 &&
+          call->getArg(0) == stmt;
+    }
+    return false;
+  }
+
+  // As for isPartOfIncrementOrDecrementExpr(), the whole operand is ignored.
+  static bool isIncrementOrDecrement(const clang::Stmt* stmt) {
+    if (const auto* op = llvm::dyn_cast<clang::UnaryOperator>(stmt)) {
+      return op->isIncrementDecrementOp();
+    }
+    if (const auto* call = llvm::dyn_cast<clang::CXXOperatorCallExpr>(stmt)) {
+      return call->getOperator() == clang::OO_PlusPlus ||
+          call->getOperator() == clang::OO_MinusMinus;
+    }
+    return false;
+  }
+
+  std::vector<Context> contexts = {{nullptr, false}};
+  std::vector<const clang::CXXOperatorCallExpr*> brackets;
+};
+
+// Finds the operator[] calls matched by Matcher::get() within a declaration.
+inline std::vector<const clang::CXXOperatorCallExpr*> find(clang::Decl& decl) {
+  OperatorBracketVisitor visitor;
+  visitor.TraverseDecl(&decl);
+  return visitor.getBrackets();
+}
+
+inline std::vector<const clang::CXXOperatorCallExpr*> find(
+    clang::ASTContext& context) {
+  return find(*context.getTranslationUnitDecl());
+}
+} // namespace Visitor
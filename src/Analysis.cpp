@@ -0,0 +1,233 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/Analysis.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+#include <clang/Lex/Lexer.h>
+
+#include <propellint/Trace.h>
+#include <propellint/Visitor.h>
+
+Analysis::Engine Analysis::parseEngine(std::string_view name) {
+  if (name == "matcher") {
+    return Engine::Matcher;
+  }
+  if (name == "visitor") {
+    return Engine::Visitor;
+  }
+  throw std::invalid_argument("Unknown engine " + std::string(name) + ".");
+}
+
+bool Analysis::SiteConsumer::shouldSkipFunctionBody(clang::Decl* decl) {
+  ++statistics.bodies;
+  const auto skippable = isSkippable(*decl);
+  if (skippable) {
+    ++statistics.skippedBodies;
+  }
+  return skippable;
+}
+
+bool Analysis::SiteConsumer::isSkippable(const clang::Decl& decl) {
+  const auto location = SM.getExpansionLoc(decl.getBeginLoc());
+  const auto presumed = SM.getPresumedLoc(location);
+  if (presumed.isInvalid()) {
+    return false;
+  }
+
+  const auto [it, inserted] =
+      files.try_emplace(SM.getFileID(location), nullptr);
+  if (inserted) {
+    const auto lines = index.find(presumed.getFilename());
+    if (lines != index.end()) {
+      it->second = &lines->second;
+    }
+  }
+  if (it->second == nullptr) {
+    return true;
+  }
+
+  const auto& lines = *it->second;
+  const auto line =
+      std::lower_bound(lines.begin(), lines.end(), presumed.getLine());
+  if (line == lines.end()) {
+    return true;
+  }
+  // The braces of member initializers would be mistaken for the body.
+  if (llvm::isa<clang::CXXConstructorDecl>(decl)) {
+    return false;
+  }
+
+  const auto end = getBodyEndLine(decl);
+  return end.has_value() && *line > *end;
+}
+
+std::optional<unsigned> Analysis::SiteConsumer::getBodyEndLine(
+    const clang::Decl& decl) const {
+  const auto start = SM.getExpansionLoc(decl.getEndLoc());
+  const auto [file, offset] = SM.getDecomposedLoc(start);
+  bool invalid = false;
+  const auto buffer = SM.getBufferData(file, &invalid);
+  if (invalid) {
+    return std::nullopt;
+  }
+
+  clang::Lexer lexer(
+      SM.getLocForStartOfFile(file),
+      langOptions,
+      buffer.begin(),
+      buffer.begin() + offset,
+      buffer.end());
+  clang::Token token;
+  int depth = 0;
+  while (!lexer.LexFromRawLexer(token)) {
+    if (token.is(clang::tok::l_brace)) {
+      ++depth;
+    } else if (token.is(clang::tok::r_brace) && --depth == 0) {
+      // Handlers of a function-try-block are part of the body.
+      const auto location = token.getLocation();
+      if (lexer.LexFromRawLexer(token) ||
+          !token.is(clang::tok::raw_identifier) ||
+          token.getRawIdentifier() != "catch") {
+        return SM.getPresumedLoc(location).getLine();
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+void Analysis::SiteConsumer::HandleTranslationUnit(
+    clang::ASTContext& context) {
+  // The rest of the file span is spent building the AST.
+  Trace::Span span("Match", "file");
+  const auto start = std::chrono::steady_clock::now();
+  switch (engine) {
+    case Engine::Matcher:
+      for (const auto& match : Matcher::matchSites(index, context)) {
+        callback(
+            *match.getNodeAs<clang::CXXOperatorCallExpr>("bracket"), context);
+      }
+      break;
+    case Engine::Visitor:
+      for (const auto* function : Matcher::findFunctions(index, context)) {
+        // The visitor does not modify the AST.
+        auto& decl = const_cast<clang::FunctionDecl&>(*function);
+        for (const auto* bracket : Visitor::find(decl)) {
+          callback(*bracket, context);
+        }
+      }
+      break;
+  }
+  statistics.matchNanoseconds +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+}
+
+// Also collects system headers, which DependencyCollector skips by default.
+class AllDependencyCollector : public clang::DependencyCollector {
+ public:
+  bool needSystemDependencies() override {
+    return true;
+  }
+};
+
+std::unique_ptr<clang::ASTConsumer> Analysis::SiteAction::CreateASTConsumer(
+    clang::CompilerInstance& CI,
+    llvm::StringRef /* file */) {
+  // Lets Sema ask the consumer which bodies to skip.
+  CI.getFrontendOpts().SkipFunctionBodies = true;
+  if (dependencies != nullptr) {
+    dependencyCollector = std::make_shared<AllDependencyCollector>();
+    dependencyCollector->attachToPreprocessor(CI.getPreprocessor());
+    // Also attaches it to the reader of a precompiled header, if any, which
+    // is only created after the consumer.
+    CI.addDependencyCollector(dependencyCollector);
+  }
+  return std::make_unique<SiteConsumer>(
+      index,
+      engine,
+      CI.getSourceManager(),
+      CI.getLangOpts(),
+      callback,
+      statistics);
+}
+
+void Analysis::SiteAction::EndSourceFileAction() {
+  if (dependencyCollector != nullptr) {
+    const auto files = dependencyCollector->getDependencies();
+    dependencies->insert(dependencies->end(), files.begin(), files.end());
+  }
+}
+
+std::vector<clang::tooling::CompileCommand>
+Analysis::FirstCommandDatabase::getCompileCommands(llvm::StringRef file) const {
+  auto commands = database.getCompileCommands(file);
+  if (commands.size() > 1) {
+    commands.resize(1);
+  }
+  return commands;
+}
+
+std::vector<clang::tooling::CompileCommand>
+Analysis::FirstCommandDatabase::getAllCompileCommands() const {
+  auto commands = database.getAllCompileCommands();
+  std::unordered_set<std::string> filenames;
+  std::erase_if(commands, [&filenames](const auto& command) {
+    return !filenames.insert(command.Filename).second;
+  });
+  return commands;
+}
+
+std::unique_ptr<clang::tooling::FrontendActionFactory>
+Analysis::newSiteActionFactory(
+    const Matcher::LineIndex& index,
+    Engine engine,
+    Callback callback,
+    Statistics& statistics,
+    std::vector<std::string>* dependencies) {
+  class Factory : public clang::tooling::FrontendActionFactory {
+   public:
+    Factory(
+        const Matcher::LineIndex& index,
+        Engine engine,
+        Callback callback,
+        Statistics& statistics,
+        std::vector<std::string>* dependencies)
+        : index(index),
+          engine(engine),
+          callback(std::move(callback)),
+          statistics(statistics),
+          dependencies(dependencies) {}
+
+    std::unique_ptr<clang::FrontendAction> create() override {
+      return std::make_unique<SiteAction>(
+          index, engine, callback, statistics, dependencies);
+    }
+
+   private:
+    const Matcher::LineIndex& index;
+    const Engine engine;
+    Callback callback;
+    Statistics& statistics;
+    std::vector<std::string>* dependencies;
+  };
+  return std::make_unique<Factory>(
+      index, engine, std::move(callback), statistics, dependencies);
+}
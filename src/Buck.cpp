@@ -14,6 +14,13 @@
 
 #include "propellint/Buck.h"
 
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+
+#include <propellint/Subprocess.h>
+#include <propellint/Trace.h>
+
 namespace json = simdjson;
 
 // Utility. Joins strings by putting a delimiter between each entry.
@@ -38,24 +45,37 @@ std::string join(Container container, std::string delimiter) {
 
 // Utility. Runs command and returns exit code and standard output.
 std::pair<int, std::string> check_output(const std::string& command) {
-  auto* stdout = popen(command.c_str(), "r");
-  assert(stdout != nullptr);
-  char chunk[256];
-  std::string output;
-  while (fgets(chunk, sizeof(chunk), stdout) != nullptr) {
-    output.append(chunk);
-  }
+  Subprocess::Result result;
+  Subprocess::run(
+      {command}, 1, [&result](std::size_t, Subprocess::Result commandResult) {
+        result = std::move(commandResult);
+      });
+  assert(result.status != -1);
 
-  const auto status = pclose(stdout);
-  assert(status != -1);
+  return {result.status, std::move(result.output)};
+}
 
-  return {status, output};
+// Calls `callback` with each target and database of a `buck build` output.
+void forEachDatabase(
+    const std::string& output,
+    const std::function<void(std::string_view, std::string_view)>& callback) {
+  json::ondemand::parser parser;
+  json::padded_string json(output);
+  json::ondemand::document document = parser.iterate(json);
+  for (auto entry : document.get_object()) {
+    const auto key = std::string_view(entry.unescaped_key());
+    callback(
+        key.substr(0, key.size() - strlen("#compilation-database")),
+        std::string_view(entry.value()));
+  }
 }
 
 std::unordered_map<std::string, std::vector<std::string>>
 Buck::getFilenameToTargetMap(
     const std::string directory,
     const std::unordered_set<std::string>& filenames) {
+  Trace::Span span("Query owners", "buck");
+  span.addArgument("files", filenames.size());
   const auto* filenames_filename = tmpnam(nullptr);
   assert(filenames_filename != nullptr);
   std::ofstream filenames_file(filenames_filename);
@@ -116,39 +136,193 @@ std::unordered_map<std::string, std::string> Buck::buildCompilationDatabases(
   return targetToDatabaseMap;
 }
 
-// A "hack" faster version -- remove "broken" targets by hand.
-// This is obviously not optimal, but speeds this up a lot.
-std::unordered_map<std::string, std::string> Buck::buildCompilationDatabases2(
-    const std::string directory,
-    const std::vector<std::string>& targets) {
-  // Add broken targets below.
-  static const auto broken = std::unordered_set<std::string>({});
+Buck::DenyList::DenyList(std::string path, std::chrono::seconds maxAge)
+    : path(std::move(path)) {
+  if (this->path.empty()) {
+    return;
+  }
+  const auto current = now();
+  std::ifstream file(this->path);
+  std::string line;
+  while (std::getline(file, line)) {
+    // Targets have no spaces. Targets without a time, as written by older
+    // versions, are taken as added now.
+    const auto space = line.rfind(' ');
+    auto added = current;
+    if (space != std::string::npos) {
+      std::from_chars(
+          line.data() + space + 1, line.data() + line.size(), added);
+      line.resize(space);
+    }
+    if (!line.empty() && current - added <= maxAge.count()) {
+      targets.emplace(std::move(line), added);
+    }
+  }
+}
 
-  const auto* targets_filename = tmpnam(nullptr);
-  assert(targets_filename != nullptr);
-  std::ofstream targets_file(targets_filename);
-  for (const auto& target : targets) {
-    if (!broken.contains(target)) {
-      const auto database_target = target + "#compilation-database";
-      targets_file << database_target << std::endl;
+void Buck::DenyList::save() const {
+  if (path.empty()) {
+    return;
+  }
+  std::vector<std::pair<std::string, int64_t>> sorted(
+      targets.begin(), targets.end());
+  std::sort(sorted.begin(), sorted.end());
+  std::ofstream file(path);
+  for (const auto& [target, added] : sorted) {
+    file << target << " " << added << std::endl;
+  }
+}
+
+// Builds the batches, running up to `jobs` buck commands at a time. A failed
+// batch is built once more, since Buck also fails for transient reasons, and
+// then again in halves, until the broken targets are isolated. The halves are
+// not retried, so that isolating a target takes one round per halving.
+// Returns these targets, after printing the errors of Buck for each.
+std::vector<std::string> buildBatches(
+    const std::string& directory,
+    const std::vector<std::vector<std::string>>& targetBatches,
+    std::size_t jobs,
+    const std::function<void(const std::string&, const std::string&)>&
+        callback) {
+  struct Batch {
+    std::vector<std::string> targets;
+    bool retried = false;
+  };
+  std::vector<Batch> batches;
+  for (const auto& targets : targetBatches) {
+    batches.push_back({targets});
+  }
+
+  std::vector<std::string> broken;
+  while (!batches.empty()) {
+    // Batches of a round run at once, so only the round has a span.
+    Trace::Span span("Build batches", "buck");
+    span.addArgument("batches", batches.size());
+    std::vector<std::string> filenames;
+    std::vector<std::string> commands;
+    for (const auto& batch : batches) {
+      const auto* targets_filename = tmpnam(nullptr);
+      assert(targets_filename != nullptr);
+      std::ofstream targets_file(targets_filename);
+      for (const auto& target : batch.targets) {
+        targets_file << target << "#compilation-database" << std::endl;
+      }
+      targets_file.close();
+      filenames.push_back(targets_filename);
+      commands.push_back(fmt::format(
+          "cd {}; buck1 build @{} --show-full-json-output 2>{}.log",
+          directory,
+          targets_filename,
+          targets_filename));
     }
+
+    std::vector<Batch> failed;
+    Subprocess::run(
+        commands, jobs, [&](std::size_t index, Subprocess::Result result) {
+          const auto log = filenames[index] + ".log";
+          std::remove(filenames[index].c_str());
+          auto& batch = batches[index];
+          if (result.status == 0) {
+            forEachDatabase(result.output, [&](auto target, auto database) {
+              callback(std::string(target), std::string(database));
+            });
+          } else if (!batch.retried) {
+            batch.retried = true;
+            failed.push_back(std::move(batch));
+          } else if (batch.targets.size() == 1) {
+            std::ifstream file(log);
+            const std::string errors(
+                (std::istreambuf_iterator<char>(file)),
+                std::istreambuf_iterator<char>());
+            std::cerr << "Could not build the compilation database of "
+                      << batch.targets.front() << ":" << std::endl
+                      << errors << std::endl;
+            broken.push_back(std::move(batch.targets.front()));
+          } else {
+            const auto middle =
+                batch.targets.begin() + batch.targets.size() / 2;
+            failed.push_back({{batch.targets.begin(), middle}, true});
+            failed.push_back({{middle, batch.targets.end()}, true});
+          }
+          std::remove(log.c_str());
+        });
+    batches = std::move(failed);
   }
-  targets_file.close();
-  const auto [status, output] = check_output(fmt::format(
-      "cd {}; buck1 build @{} --show-full-json-output",
+  return broken;
+}
+
+// Skips the denied targets, and adds the broken ones to the deny-list. The
+// deny-list is only saved if some database was built, so that a failing Buck
+// does not deny every target.
+std::vector<std::string> buildAllowedBatches(
+    const std::string& directory,
+    const std::vector<std::string>& targets,
+    std::size_t batchSize,
+    std::size_t jobs,
+    Buck::DenyList& denyList,
+    const std::function<void(const std::string&, const std::string&)>&
+        callback) {
+  std::vector<std::string> allowed;
+  std::copy_if(
+      targets.begin(),
+      targets.end(),
+      std::back_inserter(allowed),
+      [&denyList](const auto& target) { return !denyList.contains(target); });
+  std::vector<std::vector<std::string>> batches;
+  for (std::size_t first = 0; first < allowed.size(); first += batchSize) {
+    const auto last = std::min(first + batchSize, allowed.size());
+    batches.emplace_back(allowed.begin() + first, allowed.begin() + last);
+  }
+
+  bool built = false;
+  const auto broken = buildBatches(
       directory,
-      targets_filename));
-  assert(status == 0);
+      batches,
+      jobs,
+      [&](const std::string& target, const std::string& database) {
+        built = true;
+        callback(target, database);
+      });
+  for (const auto& target : broken) {
+    denyList.add(target);
+  }
+  if (built && !broken.empty()) {
+    denyList.save();
+  }
+  return broken;
+}
 
+// A faster version, building all the targets at once. Broken targets are
+// found by bisection, and skipped by later runs.
+std::unordered_map<std::string, std::string> Buck::buildCompilationDatabases2(
+    const std::string directory,
+    const std::vector<std::string>& targets,
+    DenyList& denyList) {
   std::unordered_map<std::string, std::string> targetToDatabaseMap;
-  json::ondemand::parser parser;
-  json::padded_string json(output);
-  json::ondemand::document document = parser.iterate(json);
-  for (auto entry : document.get_object()) {
-    const auto key = std::string_view(entry.unescaped_key());
-    targetToDatabaseMap.emplace(
-        key.substr(0, key.size() - strlen("#compilation-database")),
-        std::string_view(entry.value()));
-  }
+  buildAllowedBatches(
+      directory,
+      targets,
+      std::max<std::size_t>(targets.size(), 1),
+      1,
+      denyList,
+      [&](const std::string& target, const std::string& database) {
+        targetToDatabaseMap.emplace(target, database);
+      });
   return targetToDatabaseMap;
 }
+
+std::vector<std::string> Buck::buildCompilationDatabasesAsync(
+    const std::string directory,
+    const std::vector<std::string>& targets,
+    std::size_t jobs,
+    DenyList& denyList,
+    const std::function<void(const std::string&, const std::string&)>&
+        callback) {
+  // Buck only prints the outputs once the whole build is done, so batches
+  // are small enough for the first databases to be ready early.
+  const auto batchCount = std::max<std::size_t>(jobs, 1) * 4;
+  const auto batchSize = std::max<std::size_t>(
+      (targets.size() + batchCount - 1) / batchCount, 1);
+  return buildAllowedBatches(
+      directory, targets, batchSize, jobs, denyList, callback);
+}
@@ -0,0 +1,217 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/BuckCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+
+#include <propellint/Hash.h>
+
+namespace fs = std::filesystem;
+
+// The first word of the index, followed by kVersion and the configuration.
+static const std::string kMagic = "propellint-buck-cache";
+
+// The names Buck looks for build files under, by default and at Meta.
+static const std::vector<std::string> kBuildFiles = {"BUCK", "TARGETS"};
+
+// Returns the hash of the file, chained to `seed`, or nothing if the file
+// cannot be read.
+static std::optional<uint64_t> hashContents(
+    const fs::path& filename,
+    uint64_t seed) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in) {
+    return std::nullopt;
+  }
+  const std::string contents(
+      std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>{});
+  return Hash::hash(contents.data(), contents.size(), seed);
+}
+
+std::optional<std::string> BuckCache::getPackage(const std::string& target) {
+  if (!target.starts_with("//")) {
+    return std::nullopt;
+  }
+  const auto colon = target.find(':');
+  if (colon == std::string::npos) {
+    return std::nullopt;
+  }
+  return target.substr(2, colon - 2);
+}
+
+BuckCache::Cache::Cache(std::string path, std::string directory)
+    : path(std::move(path)), directory(std::move(directory)) {
+  configuration = kVersion;
+  for (const auto* name : {".buckconfig", ".buckconfig.local"}) {
+    const auto config = fs::path(this->directory) / name;
+    configuration = hashContents(config, configuration).value_or(configuration);
+  }
+
+  std::ifstream in(this->path);
+  std::string magic;
+  uint32_t version;
+  uint64_t savedConfiguration;
+  if (!(in >> magic >> version >> std::hex >> savedConfiguration >>
+        std::dec) ||
+      magic != kMagic || version != kVersion ||
+      savedConfiguration != configuration) {
+    return;
+  }
+
+  // Each entry is a line with its kind, stamp and number of values, followed
+  // by its key and its values on a line each, since paths may have spaces.
+  in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string kind;
+    uint64_t stamp;
+    std::size_t count;
+    std::string key;
+    if (!(fields >> kind >> std::hex >> stamp >> std::dec >> count) ||
+        !std::getline(in, key)) {
+      break;
+    }
+    std::vector<std::string> values;
+    std::string value;
+    while (values.size() < count && std::getline(in, value)) {
+      values.push_back(std::move(value));
+    }
+    if (values.size() < count) {
+      break;
+    }
+
+    if (kind == "owner") {
+      owners[key] = {stamp, std::move(values)};
+    } else if (kind == "database" && count == 1) {
+      databases[key] = {stamp, std::move(values.front())};
+    } else {
+      break;
+    }
+  }
+}
+
+std::unordered_map<std::string, std::vector<std::string>>
+BuckCache::Cache::getOwners(
+    const std::unordered_set<std::string>& filenames,
+    std::unordered_set<std::string>& stale) {
+  std::unordered_map<std::string, std::vector<std::string>> fresh;
+  for (const auto& filename : filenames) {
+    const auto owner = owners.find(filename);
+    if (owner != owners.end() &&
+        owner->second.stamp ==
+            getStamp(fs::path(filename).parent_path().string())) {
+      fresh.emplace(filename, owner->second.value);
+    } else {
+      stale.insert(filename);
+    }
+  }
+  return fresh;
+}
+
+void BuckCache::Cache::setOwners(
+    const std::string& filename,
+    std::vector<std::string> targets) {
+  owners[filename] = {
+      getStamp(fs::path(filename).parent_path().string()), std::move(targets)};
+}
+
+std::optional<std::string> BuckCache::Cache::getDatabase(
+    const std::string& target) {
+  const auto package = getPackage(target);
+  const auto database = databases.find(target);
+  if (!package.has_value() || database == databases.end() ||
+      database->second.stamp != getStamp(*package) ||
+      !fs::exists(database->second.value)) {
+    return std::nullopt;
+  }
+  return database->second.value;
+}
+
+void BuckCache::Cache::setDatabase(
+    const std::string& target,
+    std::string database) {
+  if (const auto package = getPackage(target)) {
+    databases[target] = {getStamp(*package), std::move(database)};
+  }
+}
+
+void BuckCache::Cache::save() const {
+  std::ostringstream out;
+  out << kMagic << " " << kVersion << " " << std::hex << configuration
+      << std::dec << "\n";
+  for (const auto& [filename, entry] : owners) {
+    out << "owner " << std::hex << entry.stamp << std::dec << " "
+        << entry.value.size() << "\n"
+        << filename << "\n";
+    for (const auto& target : entry.value) {
+      out << target << "\n";
+    }
+  }
+  for (const auto& [target, entry] : databases) {
+    out << "database " << std::hex << entry.stamp << std::dec << " 1\n"
+        << target << "\n"
+        << entry.value << "\n";
+  }
+
+  // Write to a temporary file first, so that an interrupted run does not
+  // leave a partial index.
+  const auto temporary = path + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::trunc);
+    file << out.str();
+    file.close();
+    if (!file.good()) {
+      std::cerr << "Could not write Buck cache " << path << "." << std::endl;
+      std::remove(temporary.c_str());
+      return;
+    }
+  }
+  std::rename(temporary.c_str(), path.c_str());
+}
+
+uint64_t BuckCache::Cache::getStamp(const std::string& package) {
+  const auto stamp = stamps.find(package);
+  if (stamp != stamps.end()) {
+    return stamp->second;
+  }
+
+  // The nearest build file owns the directory, so a build file added below
+  // another one changes the stamps of the directories it now owns.
+  std::optional<uint64_t> hash;
+  for (const auto& name : kBuildFiles) {
+    const auto buildFile = (fs::path(package) / name).string();
+    hash = hashContents(
+        fs::path(directory) / buildFile,
+        Hash::hash(buildFile.data(), buildFile.size(), 0));
+    if (hash.has_value()) {
+      break;
+    }
+  }
+  if (!hash.has_value()) {
+    hash = package.empty()
+        ? 0
+        : getStamp(fs::path(package).parent_path().string());
+  }
+  stamps.emplace(package, *hash);
+  return *hash;
+}
@@ -0,0 +1,188 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/CommandIndex.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#include <simdjson.h>
+
+namespace fs = std::filesystem;
+namespace json = simdjson;
+
+// A read-only memory mapping of a whole file, followed by the padding simdjson
+// reads past the end of its input. The padding is mapped from anonymous
+// memory, so the file is never copied.
+class PaddedMapping {
+ public:
+  explicit PaddedMapping(const std::string& filename) {
+    const auto fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      throw std::runtime_error("Could not open " + filename + ".");
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+      close(fd);
+      throw std::runtime_error("Could not stat " + filename + ".");
+    }
+
+    size = status.st_size;
+    const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    capacity = (size + json::SIMDJSON_PADDING + pageSize - 1) / pageSize *
+        pageSize;
+    auto* mapping = mmap(
+        nullptr, capacity, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping != MAP_FAILED && size > 0 &&
+        mmap(mapping, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+            MAP_FAILED) {
+      munmap(mapping, capacity);
+      mapping = MAP_FAILED;
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      throw std::runtime_error("Could not map " + filename + ".");
+    }
+    data = static_cast<const char*>(mapping);
+    // The file is read once, from start to end.
+    madvise(mapping, size, MADV_SEQUENTIAL);
+  }
+
+  PaddedMapping(const PaddedMapping&) = delete;
+
+  ~PaddedMapping() {
+    munmap(const_cast<char*>(data), capacity);
+  }
+
+  json::padded_string_view view() const {
+    return json::padded_string_view(data, size, capacity);
+  }
+
+ private:
+  const char* data = nullptr;
+  std::size_t size = 0;
+  std::size_t capacity = 0;
+};
+
+std::vector<std::string> CommandIndex::splitCommand(std::string_view command) {
+  std::vector<std::string> arguments;
+  std::string argument;
+  bool inArgument = false;
+  for (std::size_t i = 0; i < command.size(); ++i) {
+    const auto c = command[i];
+    if (c == ' ' || c == '\t' || c == '\n') {
+      if (inArgument) {
+        arguments.push_back(std::move(argument));
+        argument.clear();
+        inArgument = false;
+      }
+      continue;
+    }
+
+    inArgument = true;
+    if (c == '\\' && i + 1 < command.size()) {
+      argument += command[++i];
+    } else if (c == '\'') {
+      const auto end = command.find('\'', i + 1);
+      argument += command.substr(i + 1, end - i - 1);
+      i = std::min(end, command.size());
+    } else if (c == '"') {
+      // Only these characters are escaped within double quotes.
+      for (++i; i < command.size() && command[i] != '"'; ++i) {
+        if (command[i] == '\\' && i + 1 < command.size() &&
+            std::string_view("\"\\$`").find(command[i + 1]) !=
+                std::string_view::npos) {
+          ++i;
+        }
+        argument += command[i];
+      }
+    } else {
+      argument += c;
+    }
+  }
+  if (inArgument) {
+    arguments.push_back(std::move(argument));
+  }
+  return arguments;
+}
+
+std::string CommandIndex::getAbsoluteFilename(const Command& command) {
+  return (fs::path(command.directory) / command.filename)
+      .lexically_normal()
+      .string();
+}
+
+CommandIndex::Index::Index(const std::string& path) {
+  const PaddedMapping mapping(path);
+  json::ondemand::parser parser;
+  try {
+    auto document = parser.iterate(mapping.view());
+    for (json::ondemand::object entry : document.get_array()) {
+      Command command;
+      std::string_view shellCommand;
+      for (auto field : entry) {
+        const std::string_view key = field.unescaped_key();
+        if (key == "directory") {
+          command.directory = std::string_view(field.value());
+        } else if (key == "file") {
+          command.filename = std::string_view(field.value());
+        } else if (key == "output") {
+          command.output = std::string_view(field.value());
+        } else if (key == "arguments") {
+          for (auto argument : field.value().get_array()) {
+            command.arguments.emplace_back(std::string_view(argument));
+          }
+        } else if (key == "command") {
+          shellCommand = field.value();
+        }
+      }
+      // Only used when there are no arguments, as specified by Clang.
+      if (command.arguments.empty()) {
+        command.arguments = splitCommand(shellCommand);
+      }
+      files[getAbsoluteFilename(command)].push_back(commands.size());
+      commands.push_back(std::move(command));
+    }
+  } catch (const json::simdjson_error& error) {
+    throw std::runtime_error(
+        "Could not parse " + path + ": " + error.what() + ".");
+  }
+}
+
+std::vector<const CommandIndex::Command*> CommandIndex::Index::find(
+    const std::string& filename) const {
+  std::vector<const Command*> result;
+  const auto file = files.find(fs::path(filename).lexically_normal().string());
+  if (file != files.end()) {
+    for (const auto i : file->second) {
+      result.push_back(&commands[i]);
+    }
+  }
+  return result;
+}
+
+std::vector<std::string> CommandIndex::Index::getFilenames() const {
+  std::vector<std::string> filenames;
+  filenames.reserve(files.size());
+  for (const auto& [filename, _] : files) {
+    filenames.push_back(filename);
+  }
+  return filenames;
+}
@@ -0,0 +1,209 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/Commands.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+static clang::tooling::CompileCommand toCompileCommand(
+    const CommandIndex::Command& command) {
+  return clang::tooling::CompileCommand(
+      command.directory, command.filename, command.arguments, command.output);
+}
+
+std::vector<clang::tooling::CompileCommand>
+Commands::IndexDatabase::getCompileCommands(llvm::StringRef FilePath) const {
+  std::vector<clang::tooling::CompileCommand> result;
+  for (const auto* command :
+       index->find(fs::absolute(FilePath.str()).lexically_normal().string())) {
+    result.push_back(toCompileCommand(*command));
+  }
+  return result;
+}
+
+std::vector<std::string> Commands::IndexDatabase::getAllFiles() const {
+  return index->getFilenames();
+}
+
+std::vector<clang::tooling::CompileCommand>
+Commands::IndexDatabase::getAllCompileCommands() const {
+  std::vector<clang::tooling::CompileCommand> result;
+  for (const auto& command : index->getCommands()) {
+    result.push_back(toCompileCommand(command));
+  }
+  return result;
+}
+
+std::unique_ptr<clang::tooling::CompilationDatabase> Commands::loadDatabase(
+    const std::string& path,
+    std::string& error) {
+  try {
+    return std::make_unique<IndexDatabase>(
+        std::make_shared<const CommandIndex::Index>(path));
+  } catch (const std::runtime_error& exception) {
+    error = exception.what();
+    return nullptr;
+  }
+}
+
+static uint64_t getFileSize(const std::string& path) {
+  std::error_code error;
+  const auto size = fs::file_size(path, error);
+  return error ? 0 : size;
+}
+
+static Commands::Loader newFileLoader(std::string path) {
+  return [path = std::move(path)](std::string& error) {
+    return Commands::loadDatabase(path, error);
+  };
+}
+
+Commands::BuckProvider::BuckProvider(
+    std::string directory,
+    const BuckOptions& options)
+    : directory(std::move(directory)),
+      jobs(options.jobs),
+      denyList(options.denyListPath) {
+  if (!options.cachePath.empty()) {
+    cache.emplace(options.cachePath, this->directory);
+  }
+}
+
+std::unordered_map<std::string, std::vector<std::string>>
+Commands::BuckProvider::getOwners(
+    const std::unordered_set<std::string>& filenames) {
+  // Buck is only queried for the files whose build files or configuration
+  // changed since the cache was saved.
+  std::unordered_map<std::string, std::vector<std::string>> owners;
+  std::unordered_set<std::string> staleFilenames;
+  if (cache.has_value()) {
+    owners = cache->getOwners(filenames, staleFilenames);
+    std::cout << "Reused the owners of " << owners.size() << "/"
+              << filenames.size() << " files." << std::endl;
+  } else {
+    staleFilenames = filenames;
+  }
+  if (!staleFilenames.empty()) {
+    auto queried = Buck::getFilenameToTargetMap(directory, staleFilenames);
+    for (const auto& filename : staleFilenames) {
+      auto& targets = queried[filename];
+      if (cache.has_value()) {
+        cache->setOwners(filename, targets);
+      }
+      owners.emplace(filename, std::move(targets));
+    }
+    if (cache.has_value()) {
+      cache->save();
+    }
+  }
+  std::erase_if(
+      owners, [](const auto& entry) { return entry.second.empty(); });
+  return owners;
+}
+
+std::vector<std::string> Commands::BuckProvider::getDatabases(
+    const std::vector<std::string>& targets,
+    const Callback& callback) {
+  std::vector<std::string> missing;
+  std::vector<std::string> staleTargets;
+  std::size_t cached = 0;
+  for (const auto& target : targets) {
+    if (denyList.contains(target)) {
+      missing.push_back(target);
+      continue;
+    }
+    const auto database =
+        cache.has_value() ? cache->getDatabase(target) : std::nullopt;
+    if (database.has_value()) {
+      callback(target, newFileLoader(*database), getFileSize(*database));
+      ++cached;
+    } else {
+      staleTargets.push_back(target);
+    }
+  }
+  if (!missing.empty()) {
+    std::cout << "Skipping " << missing.size() << " targets of the deny-list."
+              << std::endl;
+  }
+  if (cache.has_value()) {
+    std::cout << "Reused " << cached << " cached compilation databases."
+              << std::endl;
+  }
+
+  const auto broken = Buck::buildCompilationDatabasesAsync(
+      directory,
+      staleTargets,
+      jobs,
+      denyList,
+      [&](const std::string& target, const std::string& database) {
+        if (cache.has_value()) {
+          cache->setDatabase(target, database);
+        }
+        callback(target, newFileLoader(database), getFileSize(database));
+      });
+  if (cache.has_value()) {
+    cache->save();
+  }
+  if (!broken.empty()) {
+    std::cout << "Added " << broken.size()
+              << " targets which could not be built to the deny-list."
+              << std::endl;
+  }
+  missing.insert(missing.end(), broken.begin(), broken.end());
+  return missing;
+}
+
+Commands::JsonProvider::JsonProvider(
+    std::string directory,
+    const std::string& path)
+    : directory(fs::absolute(directory).lexically_normal().string()),
+      target(path),
+      index(std::make_shared<const CommandIndex::Index>(path)) {}
+
+std::unordered_map<std::string, std::vector<std::string>>
+Commands::JsonProvider::getOwners(
+    const std::unordered_set<std::string>& filenames) {
+  std::unordered_map<std::string, std::vector<std::string>> owners;
+  for (const auto& filename : filenames) {
+    if (!index->find((fs::path(directory) / filename).string()).empty()) {
+      owners.emplace(filename, std::vector{target});
+    }
+  }
+  return owners;
+}
+
+std::vector<std::string> Commands::JsonProvider::getDatabases(
+    const std::vector<std::string>& targets,
+    const Callback& callback) {
+  std::vector<std::string> missing;
+  for (const auto& requested : targets) {
+    if (requested != target) {
+      missing.push_back(requested);
+      continue;
+    }
+    // The index is already loaded, and shared.
+    callback(
+        target,
+        [index = index](std::string&) {
+          return std::make_unique<IndexDatabase>(index);
+        },
+        0);
+  }
+  return missing;
+}
@@ -0,0 +1,255 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/FileCache.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/Path.h>
+
+// Main files are read once, and precompiled headers are written during a run,
+// so only the headers which they include are cached.
+static bool isCached(llvm::StringRef path) {
+  static const std::vector<llvm::StringRef> extensions = {
+      ".c", ".cc", ".cpp", ".cxx", ".c++", ".m", ".mm", ".pch", ".gch", ".pcm"};
+  return std::find(
+             extensions.begin(),
+             extensions.end(),
+             llvm::sys::path::extension(path)) == extensions.end();
+}
+
+template <typename T, typename F, typename K>
+T FileCache::Cache::get(
+    std::unordered_map<std::string, T>& map,
+    const std::string& key,
+    F compute,
+    K keep) {
+  {
+    const std::shared_lock lock(mutex);
+    const auto it = map.find(key);
+    if (it != map.end()) {
+      ++statistics.hits;
+      return it->second;
+    }
+  }
+
+  ++statistics.misses;
+  auto value = compute();
+  const std::unique_lock lock(mutex);
+  const auto it = map.find(key);
+  if (it != map.end()) {
+    return it->second;
+  }
+  if (!keep(value)) {
+    return value;
+  }
+  return map.emplace(key, std::move(value)).first->second;
+}
+
+llvm::ErrorOr<llvm::vfs::Status> FileCache::Cache::status(
+    const std::string& path,
+    llvm::vfs::FileSystem& fs) {
+  return get(
+      statuses,
+      path,
+      [&] { return fs.status(path); },
+      [](const auto& /* status */) { return true; });
+}
+
+llvm::ErrorOr<std::shared_ptr<llvm::MemoryBuffer>> FileCache::Cache::getBuffer(
+    const std::string& path,
+    llvm::vfs::FileSystem& fs) {
+  return get(
+      buffers,
+      path,
+      [&]() -> llvm::ErrorOr<std::shared_ptr<llvm::MemoryBuffer>> {
+        auto buffer = fs.getBufferForFile(path);
+        if (!buffer) {
+          return buffer.getError();
+        }
+        return std::shared_ptr<llvm::MemoryBuffer>(std::move(*buffer));
+      },
+      [this](const auto& buffer) {
+        const auto size = buffer ? (*buffer)->getBufferSize() : 0;
+        if (bufferBytes + size > maxBufferBytes) {
+          return false;
+        }
+        bufferBytes += size;
+        return true;
+      });
+}
+
+llvm::ErrorOr<std::vector<llvm::vfs::directory_entry>>
+FileCache::Cache::listDirectory(
+    const std::string& path,
+    llvm::vfs::FileSystem& fs) {
+  return get(
+      directories,
+      path,
+      [&]() -> llvm::ErrorOr<std::vector<llvm::vfs::directory_entry>> {
+        std::error_code error;
+        std::vector<llvm::vfs::directory_entry> entries;
+        for (auto it = fs.dir_begin(path, error);
+             !error && it != llvm::vfs::directory_iterator();
+             it.increment(error)) {
+          entries.push_back(*it);
+        }
+        if (error) {
+          return error;
+        }
+        return entries;
+      },
+      [](const auto& /* entries */) { return true; });
+}
+
+// A file whose contents are shared with the cache, unless read as volatile.
+class CachedFile : public llvm::vfs::File {
+ public:
+  CachedFile(
+      llvm::vfs::Status status,
+      std::shared_ptr<llvm::MemoryBuffer> buffer,
+      std::string path)
+      : fileStatus(std::move(status)),
+        buffer(std::move(buffer)),
+        path(std::move(path)) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status() override {
+    return fileStatus;
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> getBuffer(
+      const llvm::Twine& name,
+      int64_t /* fileSize */,
+      bool requiresNullTerminator,
+      bool isVolatile) override {
+    if (isVolatile) {
+      return llvm::vfs::getRealFileSystem()->getBufferForFile(
+          path, -1, requiresNullTerminator, isVolatile);
+    }
+    // Cached buffers are null-terminated.
+    return llvm::MemoryBuffer::getMemBuffer(
+        buffer->getBuffer(), name.str(), requiresNullTerminator);
+  }
+
+  std::error_code close() override {
+    return {};
+  }
+
+ private:
+  const llvm::vfs::Status fileStatus;
+  const std::shared_ptr<llvm::MemoryBuffer> buffer;
+  // Absolute.
+  const std::string path;
+};
+
+// Serves a cached directory listing.
+class CachedDirectoryIterator : public llvm::vfs::detail::DirIterImpl {
+ public:
+  explicit CachedDirectoryIterator(
+      std::vector<llvm::vfs::directory_entry> entries)
+      : entries(std::move(entries)) {
+    setCurrentEntry();
+  }
+
+  std::error_code increment() override {
+    ++index;
+    setCurrentEntry();
+    return {};
+  }
+
+ private:
+  void setCurrentEntry() {
+    CurrentEntry = index < entries.size() ? entries[index]
+                                          : llvm::vfs::directory_entry();
+  }
+
+  const std::vector<llvm::vfs::directory_entry> entries;
+  std::size_t index = 0;
+};
+
+// Answers from the cache, with paths made absolute against its own working
+// directory.
+class CachingFileSystem : public llvm::vfs::ProxyFileSystem {
+ public:
+  explicit CachingFileSystem(FileCache::Cache& cache)
+      : ProxyFileSystem(llvm::vfs::createPhysicalFileSystem()),
+        cache(cache) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& path) override {
+    const auto absolute = getAbsolutePath(path);
+    if (!isCached(absolute)) {
+      return ProxyFileSystem::status(path);
+    }
+    const auto result = cache.status(absolute, getUnderlyingFS());
+    if (!result) {
+      return result;
+    }
+    return llvm::vfs::Status::copyWithNewName(*result, path);
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(
+      const llvm::Twine& path) override {
+    const auto absolute = getAbsolutePath(path);
+    if (!isCached(absolute)) {
+      return ProxyFileSystem::openFileForRead(path);
+    }
+    const auto fileStatus = cache.status(absolute, getUnderlyingFS());
+    if (!fileStatus) {
+      return fileStatus.getError();
+    }
+    auto buffer = cache.getBuffer(absolute, getUnderlyingFS());
+    if (!buffer) {
+      return buffer.getError();
+    }
+    return std::make_unique<CachedFile>(
+        llvm::vfs::Status::copyWithNewName(*fileStatus, path),
+        std::move(*buffer),
+        absolute);
+  }
+
+  llvm::vfs::directory_iterator dir_begin(
+      const llvm::Twine& path,
+      std::error_code& error) override {
+    auto entries =
+        cache.listDirectory(getAbsolutePath(path), getUnderlyingFS());
+    if (!entries) {
+      error = entries.getError();
+      return {};
+    }
+    error = {};
+    return llvm::vfs::directory_iterator(
+        std::make_shared<CachedDirectoryIterator>(std::move(*entries)));
+  }
+
+ private:
+  // Only . components are removed: .. after a symlinked directory, as in
+  // toolchain include paths, goes up from its target, so dropping it by text
+  // would name another file.
+  std::string getAbsolutePath(const llvm::Twine& path) {
+    llvm::SmallString<256> absolute;
+    path.toVector(absolute);
+    getUnderlyingFS().makeAbsolute(absolute);
+    llvm::sys::path::remove_dots(absolute, /* remove_dot_dot= */ false);
+    return std::string(absolute);
+  }
+
+  FileCache::Cache& cache;
+};
+
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FileCache::newFileSystem(
+    Cache& cache) {
+  return llvm::makeIntrusiveRefCnt<CachingFileSystem>(cache);
+}
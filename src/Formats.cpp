@@ -0,0 +1,674 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/Formats.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <zlib.h>
+
+// Cheap prefilter, the same as for JSON profiles: stacks without any
+// operator[] frame are never interned.
+constexpr std::string_view kOperatorBracket = "operator[]";
+
+std::ifstream openFile(const std::string& filename) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("Could not open " + filename + ".");
+  }
+  return in;
+}
+
+// Measures the time spent reading a profile.
+class ScanTimer {
+ public:
+  explicit ScanTimer(Profile::IngestionStatistics& statistics)
+      : statistics(statistics), start(std::chrono::steady_clock::now()) {}
+
+  ~ScanTimer() {
+    statistics.scanSeconds += std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count();
+  }
+
+ private:
+  Profile::IngestionStatistics& statistics;
+  std::chrono::steady_clock::time_point start;
+};
+
+Formats::Format Formats::parse(std::string_view name) {
+  if (name == "json") {
+    return Format::Json;
+  }
+  if (name == "folded") {
+    return Format::Folded;
+  }
+  if (name == "perf") {
+    return Format::PerfScript;
+  }
+  if (name == "pprof") {
+    return Format::Pprof;
+  }
+  throw std::invalid_argument(
+      "Unknown profile format " + std::string(name) + ".");
+}
+
+// Profiles may contain any byte, which <cctype> only takes as unsigned char.
+static bool isSpace(char c) {
+  return std::isspace(static_cast<unsigned char>(c));
+}
+
+bool isHexAddress(std::string_view token) {
+  return !token.empty() && std::all_of(token.begin(), token.end(), [](char c) {
+    return std::isxdigit(static_cast<unsigned char>(c));
+  });
+}
+
+Formats::Format Formats::detect(const std::string& filename) {
+  auto in = openFile(filename);
+  std::string head(64 * 1024, '\0');
+  in.read(head.data(), head.size());
+  head.resize(in.gcount());
+
+  // gzip, or a raw protobuf (which starts with a field tag).
+  if (head.size() >= 2 && uint8_t(head[0]) == 0x1f &&
+      uint8_t(head[1]) == 0x8b) {
+    return Format::Pprof;
+  }
+  const auto start = std::find_if_not(head.begin(), head.end(), isSpace);
+  if (start == head.end()) {
+    return Format::Json;
+  }
+  if (*start == '[' || *start == '{') {
+    return Format::Json;
+  }
+  if (!std::isprint(static_cast<unsigned char>(*start))) {
+    return Format::Pprof;
+  }
+
+  // perf script indents frames ("\t address symbol (dso)") below a header.
+  std::string_view lines(head);
+  while (!lines.empty()) {
+    const auto end = std::min(lines.find('\n'), lines.size());
+    auto line = lines.substr(0, end);
+    lines.remove_prefix(std::min(end + 1, lines.size()));
+    if (line.empty() || !isSpace(line.front())) {
+      continue;
+    }
+    line.remove_prefix(line.find_first_not_of(" \t"));
+    if (isHexAddress(line.substr(0, line.find(' ')))) {
+      return Format::PerfScript;
+    }
+  }
+  return Format::Folded;
+}
+
+Profile::FoldedStacks Formats::readFolded(
+    const std::string& filename,
+    Profile::IngestionStatistics& statistics) {
+  const ScanTimer timer(statistics);
+  auto in = openFile(filename);
+  Profile::FoldedStacks stacks;
+  std::vector<uint32_t> stack;
+  std::string line;
+  while (std::getline(in, line)) {
+    statistics.scannedBytes += line.size() + 1;
+    const auto space = line.rfind(' ');
+    uint64_t weight = 0;
+    if (space == std::string::npos ||
+        std::from_chars(
+            line.data() + space + 1, line.data() + line.size(), weight)
+                .ec != std::errc()) {
+      continue;
+    }
+
+    ++statistics.records;
+    auto frames = std::string_view(line.data(), space);
+    if (frames.find(kOperatorBracket) == std::string_view::npos) {
+      ++statistics.skippedRecords;
+      continue;
+    }
+
+    stack.clear();
+    while (!frames.empty()) {
+      const auto end = std::min(frames.find(';'), frames.size());
+      stack.push_back(stacks.getFrameId(frames.substr(0, end)));
+      frames.remove_prefix(std::min(end + 1, frames.size()));
+    }
+    stacks.add(stack, weight);
+  }
+
+  statistics.uniqueStacks = stacks.size();
+  return stacks;
+}
+
+struct PerfFrame {
+  std::string function;
+  std::string filename;
+  int line = -1;
+};
+
+// Parses the weight of a sample from its header line:
+// "comm pid [cpu] time: period event: ..." where the period is optional.
+uint64_t parsePerfPeriod(std::string_view header) {
+  std::vector<std::string_view> tokens;
+  while (!header.empty()) {
+    const auto begin = header.find_first_not_of(" \t");
+    if (begin == std::string_view::npos) {
+      break;
+    }
+    header.remove_prefix(begin);
+    const auto end = std::min(header.find_first_of(" \t"), header.size());
+    tokens.push_back(header.substr(0, end));
+    header.remove_prefix(end);
+  }
+
+  for (std::size_t i = tokens.size(); i-- > 1;) {
+    if (tokens[i].back() == ':') {
+      uint64_t period = 0;
+      const auto& token = tokens[i - 1];
+      if (std::from_chars(token.data(), token.data() + token.size(), period)
+                  .ec == std::errc() &&
+          period != 0) {
+        return period;
+      }
+      break;
+    }
+  }
+  return 1;
+}
+
+Profile::FoldedStacks Formats::readPerfScript(
+    const std::string& filename,
+    Profile::IngestionStatistics& statistics) {
+  const ScanTimer timer(statistics);
+  auto in = openFile(filename);
+  Profile::FoldedStacks stacks;
+  std::vector<PerfFrame> frames;
+  uint64_t weight = 0;
+  bool hasOperatorBracket = false;
+  std::vector<uint32_t> stack;
+
+  const auto flush = [&]() {
+    if (frames.empty()) {
+      return;
+    }
+    ++statistics.records;
+    if (!hasOperatorBracket) {
+      ++statistics.skippedRecords;
+    } else {
+      // perf prints the leaf first.
+      stack.clear();
+      for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+        stack.push_back(
+            stacks.getFrameId(it->function, it->filename, it->line));
+      }
+      stacks.add(stack, weight);
+    }
+    frames.clear();
+    hasOperatorBracket = false;
+  };
+
+  std::string line;
+  while (std::getline(in, line)) {
+    statistics.scannedBytes += line.size() + 1;
+    if (line.empty()) {
+      flush();
+      continue;
+    }
+
+    if (!isSpace(line.front())) {
+      flush();
+      weight = parsePerfPeriod(line);
+      continue;
+    }
+
+    auto content = std::string_view(line);
+    content.remove_prefix(
+        std::min(content.find_first_not_of(" \t"), content.size()));
+    const auto space = content.find(' ');
+    if (space != std::string_view::npos &&
+        isHexAddress(content.substr(0, space))) {
+      // "address symbol+offset (dso)"
+      auto symbol = content.substr(space + 1);
+      const auto dso = symbol.rfind(" (");
+      if (dso != std::string_view::npos && symbol.back() == ')') {
+        symbol = symbol.substr(0, dso);
+      }
+      const auto offset = symbol.rfind("+0x");
+      if (offset != std::string_view::npos) {
+        symbol = symbol.substr(0, offset);
+      }
+      hasOperatorBracket = hasOperatorBracket ||
+          symbol.find(kOperatorBracket) != std::string_view::npos;
+      frames.push_back({std::string(symbol), {}, -1});
+    } else if (!frames.empty()) {
+      // "filename:line", the source line of the previous frame.
+      const auto colon = content.rfind(':');
+      int lineNumber = -1;
+      if (colon != std::string_view::npos &&
+          std::from_chars(
+              content.data() + colon + 1,
+              content.data() + content.size(),
+              lineNumber)
+                  .ec == std::errc()) {
+        frames.back().filename = content.substr(0, colon);
+        frames.back().line = lineNumber;
+      }
+    }
+  }
+  flush();
+
+  statistics.uniqueStacks = stacks.size();
+  return stacks;
+}
+
+// Reads a possibly gzipped file incrementally.
+class InputStream {
+ public:
+  explicit InputStream(const std::string& filename)
+      : in(openFile(filename)), input(kBufferSize), output(kBufferSize) {
+    const auto first = in.peek();
+    gzipped = first == 0x1f;
+    if (gzipped && inflateInit2(&stream, 15 + 32) != Z_OK) {
+      throw std::runtime_error("Could not initialize zlib.");
+    }
+  }
+
+  InputStream(const InputStream&) = delete;
+
+  ~InputStream() {
+    if (gzipped) {
+      inflateEnd(&stream);
+    }
+  }
+
+  // Returns false at the end of the input.
+  bool read(char* data, std::size_t size) {
+    while (size != 0) {
+      if (position == available && !refill()) {
+        return false;
+      }
+      const auto count = std::min(size, available - position);
+      std::copy_n(output.data() + position, count, data);
+      position += count;
+      data += count;
+      size -= count;
+    }
+    return true;
+  }
+
+  bool readVarint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      char byte;
+      if (!read(&byte, 1)) {
+        if (shift == 0) {
+          return false;
+        }
+        throw std::runtime_error("Truncated varint.");
+      }
+      value |= uint64_t(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    throw std::runtime_error("Invalid varint.");
+  }
+
+  std::size_t getBytesRead() const {
+    return bytesRead;
+  }
+
+ private:
+  static constexpr std::size_t kBufferSize = 1 << 20;
+
+  bool refill() {
+    position = 0;
+    available = 0;
+    if (!gzipped) {
+      in.read(output.data(), output.size());
+      available = in.gcount();
+      bytesRead += available;
+      return available != 0;
+    }
+
+    while (available == 0) {
+      if (stream.avail_in == 0) {
+        in.read(input.data(), input.size());
+        if (in.gcount() == 0) {
+          return false;
+        }
+        bytesRead += in.gcount();
+        stream.next_in = reinterpret_cast<Bytef*>(input.data());
+        stream.avail_in = in.gcount();
+      }
+
+      stream.next_out = reinterpret_cast<Bytef*>(output.data());
+      stream.avail_out = output.size();
+      const auto status = inflate(&stream, Z_NO_FLUSH);
+      if (status == Z_STREAM_END) {
+        // Concatenated gzip members.
+        inflateReset(&stream);
+      } else if (status != Z_OK && status != Z_BUF_ERROR) {
+        throw std::runtime_error("Could not decompress the profile.");
+      }
+      available = output.size() - stream.avail_out;
+    }
+    return true;
+  }
+
+  std::ifstream in;
+  bool gzipped;
+  z_stream stream = {};
+  std::vector<char> input;
+  std::vector<char> output;
+  std::size_t position = 0;
+  std::size_t available = 0;
+  std::size_t bytesRead = 0;
+};
+
+// Decodes the fields of an in-memory protobuf message.
+class Message {
+ public:
+  explicit Message(std::string_view data) : data(data) {}
+
+  bool next() {
+    if (data.empty()) {
+      return false;
+    }
+    const auto key = readVarint();
+    field = key >> 3;
+    wireType = key & 7;
+    return true;
+  }
+
+  uint32_t getField() const {
+    return field;
+  }
+
+  uint64_t readVarint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64 && !data.empty(); shift += 7) {
+      const auto byte = uint8_t(data.front());
+      data.remove_prefix(1);
+      value |= uint64_t(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return value;
+      }
+    }
+    throw std::runtime_error("Invalid varint.");
+  }
+
+  std::string_view readBytes() {
+    const auto size = readVarint();
+    if (size > data.size()) {
+      throw std::runtime_error("Truncated message.");
+    }
+    const auto bytes = data.substr(0, size);
+    data.remove_prefix(size);
+    return bytes;
+  }
+
+  // Repeated integers, packed or not.
+  template <typename T>
+  void readIntegers(std::vector<T>& values) {
+    if (wireType == 2) {
+      Message packed(readBytes());
+      while (!packed.data.empty()) {
+        values.push_back(packed.readVarint());
+      }
+    } else {
+      values.push_back(readVarint());
+    }
+  }
+
+  void skip() {
+    switch (wireType) {
+      case 0:
+        readVarint();
+        break;
+      case 1:
+        data.remove_prefix(std::min<std::size_t>(8, data.size()));
+        break;
+      case 2:
+        readBytes();
+        break;
+      case 5:
+        data.remove_prefix(std::min<std::size_t>(4, data.size()));
+        break;
+      default:
+        throw std::runtime_error("Unsupported wire type.");
+    }
+  }
+
+ private:
+  std::string_view data;
+  uint32_t field = 0;
+  uint32_t wireType = 0;
+};
+
+struct VectorHash {
+  std::size_t operator()(const std::vector<uint64_t>& values) const noexcept {
+    std::size_t seed = values.size();
+    for (const auto value : values) {
+      seed = (seed ^ value) * 0x9e3779b97f4a7c15;
+      seed ^= seed >> 32;
+    }
+    return seed;
+  }
+};
+
+Profile::FoldedStacks Formats::readPprof(
+    const std::string& filename,
+    Profile::IngestionStatistics& statistics) {
+  const ScanTimer timer(statistics);
+  InputStream in(filename);
+
+  // Samples reference locations and functions which may come later in the
+  // file, so they are folded by location identifiers while streaming, and only
+  // resolved once the whole profile has been read.
+  std::unordered_map<std::vector<uint64_t>, uint64_t, VectorHash> samples;
+  struct Line {
+    uint64_t function;
+    int64_t line;
+  };
+  struct Location {
+    uint64_t address = 0;
+    std::vector<Line> lines;
+  };
+  struct Function {
+    uint64_t name = 0;
+    uint64_t filename = 0;
+  };
+  std::unordered_map<uint64_t, Location> locations;
+  std::unordered_map<uint64_t, Function> functions;
+  std::vector<std::string> strings;
+
+  std::string buffer;
+  std::vector<uint64_t> locationIds;
+  std::vector<int64_t> values;
+  uint64_t key;
+  while (in.readVarint(key)) {
+    const auto field = key >> 3;
+    const auto wireType = key & 7;
+    if (wireType != 2) {
+      uint64_t value;
+      if (wireType == 0) {
+        in.readVarint(value);
+      } else if (wireType == 1 || wireType == 5) {
+        buffer.resize(wireType == 1 ? 8 : 4);
+        in.read(buffer.data(), buffer.size());
+      } else {
+        throw std::runtime_error("Unsupported wire type.");
+      }
+      continue;
+    }
+
+    uint64_t size;
+    if (!in.readVarint(size)) {
+      throw std::runtime_error("Truncated profile.");
+    }
+    buffer.resize(size);
+    if (!in.read(buffer.data(), size)) {
+      throw std::runtime_error("Truncated profile.");
+    }
+    Message message(buffer);
+
+    switch (field) {
+      case 2: { // Sample
+        locationIds.clear();
+        values.clear();
+        while (message.next()) {
+          if (message.getField() == 1) {
+            message.readIntegers(locationIds);
+          } else if (message.getField() == 2) {
+            message.readIntegers(values);
+          } else {
+            message.skip();
+          }
+        }
+        if (!values.empty() && values.back() > 0) {
+          samples[locationIds] += values.back();
+        }
+        break;
+      }
+      case 4: { // Location
+        uint64_t id = 0;
+        Location location;
+        while (message.next()) {
+          if (message.getField() == 1) {
+            id = message.readVarint();
+          } else if (message.getField() == 3) {
+            location.address = message.readVarint();
+          } else if (message.getField() == 4) {
+            Line line = {0, -1};
+            Message lineMessage(message.readBytes());
+            while (lineMessage.next()) {
+              if (lineMessage.getField() == 1) {
+                line.function = lineMessage.readVarint();
+              } else if (lineMessage.getField() == 2) {
+                line.line = lineMessage.readVarint();
+              } else {
+                lineMessage.skip();
+              }
+            }
+            location.lines.push_back(line);
+          } else {
+            message.skip();
+          }
+        }
+        locations[id] = std::move(location);
+        break;
+      }
+      case 5: { // Function
+        uint64_t id = 0;
+        Function function;
+        while (message.next()) {
+          if (message.getField() == 1) {
+            id = message.readVarint();
+          } else if (message.getField() == 2) {
+            function.name = message.readVarint();
+          } else if (message.getField() == 4) {
+            function.filename = message.readVarint();
+          } else {
+            message.skip();
+          }
+        }
+        functions[id] = function;
+        break;
+      }
+      case 6: // String table
+        strings.push_back(buffer);
+        break;
+    }
+  }
+  statistics.scannedBytes += in.getBytesRead();
+
+  const auto getString = [&strings](uint64_t index) -> std::string_view {
+    return index < strings.size() ? std::string_view(strings[index])
+                                  : std::string_view();
+  };
+
+  Profile::FoldedStacks stacks;
+  std::vector<uint32_t> stack;
+  for (const auto& [sample, weight] : samples) {
+    ++statistics.records;
+    stack.clear();
+    bool hasOperatorBracket = false;
+    // Locations are leaf first, and the lines of a location innermost first.
+    for (auto id = sample.rbegin(); id != sample.rend(); ++id) {
+      const auto location = locations.find(*id);
+      if (location == locations.end() || location->second.lines.empty()) {
+        char address[32];
+        const auto end = std::to_chars(
+            address,
+            address + sizeof(address),
+            location == locations.end() ? 0 : location->second.address,
+            16);
+        stack.push_back(stacks.getFrameId(
+            "0x" + std::string(address, end.ptr), {}, -1));
+        continue;
+      }
+
+      const auto& lines = location->second.lines;
+      for (auto line = lines.rbegin(); line != lines.rend(); ++line) {
+        const auto& function = functions[line->function];
+        const auto name = getString(function.name);
+        hasOperatorBracket = hasOperatorBracket ||
+            name.find(kOperatorBracket) != std::string_view::npos;
+        stack.push_back(stacks.getFrameId(
+            name, getString(function.filename), int(line->line)));
+      }
+    }
+
+    if (!hasOperatorBracket) {
+      ++statistics.skippedRecords;
+      continue;
+    }
+    stacks.add(stack, weight);
+  }
+
+  statistics.uniqueStacks = stacks.size();
+  return stacks;
+}
+
+Profile::FoldedStacks Formats::getFoldedStacks(
+    const std::string& filename,
+    Format format,
+    const Signatures::Table& signatures,
+    std::size_t jobs,
+    std::size_t windowSize,
+    Profile::IngestionStatistics& statistics,
+    bool normalizeFrames) {
+  switch (format) {
+    case Format::Json:
+      return Profile::getFoldedStacks(
+          filename, signatures, jobs, windowSize, statistics, normalizeFrames);
+    case Format::Folded:
+      return readFolded(filename, statistics);
+    case Format::PerfScript:
+      return readPerfScript(filename, statistics);
+    case Format::Pprof:
+      return readPprof(filename, statistics);
+  }
+  throw std::invalid_argument("Unknown profile format.");
+}
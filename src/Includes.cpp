@@ -0,0 +1,185 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/Includes.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <tuple>
+
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/FrontendActions.h>
+#include <clang/Lex/PPCallbacks.h>
+#include <clang/Lex/Preprocessor.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/Path.h>
+
+namespace fs = std::filesystem;
+
+bool Includes::isHeader(std::string_view filename) {
+  static const std::vector<std::string_view> extensions = {
+      ".h", ".hh", ".hpp", ".hxx", ".h++", ".inl", ".ipp", ".tcc"};
+  return std::any_of(
+      extensions.begin(), extensions.end(), [filename](const auto& extension) {
+        return filename.ends_with(extension);
+      });
+}
+
+// Records the files entered by the preprocessor, and the bytes preprocessed.
+class IncludeCollector : public clang::PPCallbacks {
+ public:
+  IncludeCollector(
+      const clang::SourceManager& SM,
+      std::vector<std::string>& filenames,
+      uint64_t& cost)
+      : SM(SM), filenames(filenames), cost(cost) {}
+
+  void FileChanged(
+      clang::SourceLocation location,
+      FileChangeReason reason,
+      clang::SrcMgr::CharacteristicKind /* kind */,
+      clang::FileID /* previous */) override {
+    if (reason != EnterFile) {
+      return;
+    }
+    const auto file = SM.getFileID(location);
+    cost += SM.getBufferData(file).size();
+    const auto filename = SM.getFilename(location);
+    if (!filename.empty()) {
+      filenames.push_back(filename.str());
+    }
+  }
+
+ private:
+  const clang::SourceManager& SM;
+  std::vector<std::string>& filenames;
+  uint64_t& cost;
+};
+
+class IncludeScanAction : public clang::PreprocessOnlyAction {
+ public:
+  // Called with the absolute filenames of the main file and of the files it
+  // includes, and its cost.
+  using Callback = std::function<
+      void(const std::string&, const std::vector<std::string>&, uint64_t)>;
+
+  explicit IncludeScanAction(const Callback& callback) : callback(callback) {}
+
+ protected:
+  bool BeginSourceFileAction(clang::CompilerInstance& CI) override {
+    auto& preprocessor = CI.getPreprocessor();
+    preprocessor.addPPCallbacks(std::make_unique<IncludeCollector>(
+        preprocessor.getSourceManager(), filenames, cost));
+    return true;
+  }
+
+  void EndSourceFileAction() override {
+    for (auto& filename : filenames) {
+      filename = makeAbsolute(filename);
+    }
+    callback(makeAbsolute(getCurrentFile()), filenames, cost);
+  }
+
+ private:
+  std::string makeAbsolute(llvm::StringRef filename) {
+    llvm::SmallString<256> path(filename);
+    getCompilerInstance().getFileManager().makeAbsolutePath(path);
+    llvm::sys::path::remove_dots(path, true);
+    return path.str().str();
+  }
+
+  const Callback& callback;
+  std::vector<std::string> filenames;
+  uint64_t cost = 0;
+};
+
+Includes::Index::Index(
+    const std::string& directory,
+    std::unordered_set<std::string> headers)
+    : directory(fs::absolute(directory).lexically_normal().string() + "/"),
+      headers(std::move(headers)) {}
+
+void Includes::Index::scan(
+    const std::string& target,
+    const clang::tooling::CompilationDatabase& database,
+    const std::vector<std::string>& files,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fileSystem) {
+  IncludeScanAction::Callback callback =
+      [&](const std::string& main,
+          const std::vector<std::string>& filenames,
+          uint64_t cost) {
+        if (!main.starts_with(directory)) {
+          return;
+        }
+        const Includer includer = {
+            target, main.substr(directory.size()), cost};
+        for (const auto& filename : filenames) {
+          if (filename.starts_with(directory)) {
+            const auto header = filename.substr(directory.size());
+            if (headers.contains(header)) {
+              add(header, includer);
+            }
+          }
+        }
+      };
+
+  class Factory : public clang::tooling::FrontendActionFactory {
+   public:
+    explicit Factory(const IncludeScanAction::Callback& callback)
+        : callback(callback) {}
+
+    std::unique_ptr<clang::FrontendAction> create() override {
+      return std::make_unique<IncludeScanAction>(callback);
+    }
+
+   private:
+    const IncludeScanAction::Callback& callback;
+  };
+
+  clang::tooling::ClangTool tool(
+      database,
+      files,
+      std::make_shared<clang::PCHContainerOperations>(),
+      std::move(fileSystem));
+  // Missing files are expected, since nothing is built.
+  clang::IgnoringDiagConsumer diagnostics;
+  tool.setDiagnosticConsumer(&diagnostics);
+  Factory factory(callback);
+  tool.run(&factory);
+}
+
+void Includes::Index::add(const std::string& header, const Includer& includer) {
+  const std::lock_guard lock(mutex);
+  const auto [it, inserted] = includers.try_emplace(header, includer);
+  if (!inserted &&
+      std::tie(includer.cost, includer.filename) <
+          std::tie(it->second.cost, it->second.filename)) {
+    it->second = includer;
+  }
+}
+
+std::optional<Includes::Includer> Includes::Index::find(
+    const std::string& header) const {
+  const std::lock_guard lock(mutex);
+  const auto it = includers.find(header);
+  if (it == includers.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
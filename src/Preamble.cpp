@@ -0,0 +1,223 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/Preamble.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+
+#include <clang/Frontend/FrontendActions.h>
+#include <clang/Tooling/ArgumentsAdjusters.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <propellint/Hash.h>
+
+namespace fs = std::filesystem;
+
+static std::string_view trimLeft(std::string_view text) {
+  const auto start = text.find_first_not_of(" \t\r");
+  return start == std::string_view::npos ? std::string_view()
+                                         : text.substr(start);
+}
+
+// Removes a trailing line comment and whitespace.
+static std::string_view trimRight(std::string_view text) {
+  const auto comment = text.find("//");
+  if (comment != std::string_view::npos) {
+    text = text.substr(0, comment);
+  }
+  const auto end = text.find_last_not_of(" \t\r");
+  return end == std::string_view::npos ? std::string_view()
+                                       : text.substr(0, end + 1);
+}
+
+// Returns the include as written, such as <map> or "a.h", if the line is an
+// #include directive.
+static std::optional<std::string_view> parseInclude(std::string_view line) {
+  if (!line.starts_with("#")) {
+    return std::nullopt;
+  }
+  line = trimLeft(line.substr(1));
+  if (!line.starts_with("include")) {
+    return std::nullopt;
+  }
+  line = trimRight(trimLeft(line.substr(std::string_view("include").size())));
+  if (line.size() < 2 ||
+      !((line.front() == '<' && line.back() == '>') ||
+        (line.front() == '"' && line.back() == '"'))) {
+    return std::nullopt;
+  }
+  return line;
+}
+
+std::vector<std::string> Preamble::getIncludes(std::string_view code) {
+  std::vector<std::string> includes;
+  bool inComment = false;
+  while (!code.empty()) {
+    const auto end = code.find('\n');
+    auto line = trimLeft(code.substr(0, end));
+    code = end == std::string_view::npos ? std::string_view()
+                                         : code.substr(end + 1);
+
+    if (inComment) {
+      const auto commentEnd = line.find("*/");
+      if (commentEnd == std::string_view::npos) {
+        continue;
+      }
+      inComment = false;
+      line = trimLeft(line.substr(commentEnd + 2));
+    }
+    if (line.starts_with("/*")) {
+      const auto commentEnd = line.find("*/", 2);
+      if (commentEnd == std::string_view::npos) {
+        inComment = true;
+        continue;
+      }
+      line = trimLeft(line.substr(commentEnd + 2));
+    }
+    if (trimRight(line).empty()) {
+      continue;
+    }
+
+    const auto include = parseInclude(line);
+    if (!include.has_value()) {
+      break;
+    }
+    includes.push_back("#include " + std::string(*include));
+  }
+  return includes;
+}
+
+std::vector<std::string> Preamble::getCommonPrefix(
+    const std::vector<std::vector<std::string>>& includes) {
+  if (includes.empty()) {
+    return {};
+  }
+
+  auto prefix = includes.front();
+  for (const auto& other : includes) {
+    const auto mismatch = std::mismatch(
+        prefix.begin(), prefix.end(), other.begin(), other.end());
+    prefix.erase(mismatch.first, prefix.end());
+  }
+  return prefix;
+}
+
+// Returns the arguments without the compiler, the file and the outputs.
+static std::vector<std::string> getArguments(
+    const clang::tooling::CompileCommand& command) {
+  auto arguments = clang::tooling::combineAdjusters(
+      clang::tooling::getClangStripOutputAdjuster(),
+      clang::tooling::getClangStripDependencyFileAdjuster())(
+      command.CommandLine, command.Filename);
+
+  const auto filename =
+      (fs::path(command.Directory) / command.Filename).lexically_normal();
+  std::erase_if(arguments, [&](const auto& argument) {
+    return (fs::path(command.Directory) / argument).lexically_normal() ==
+        filename;
+  });
+  if (!arguments.empty()) {
+    arguments.erase(arguments.begin());
+  }
+  return arguments;
+}
+
+std::string Preamble::getGroupKey(
+    const clang::tooling::CompileCommand& command) {
+  std::string key = command.Directory;
+  key += '\0';
+  key += fs::path(command.Filename).parent_path().string();
+  for (const auto& argument : getArguments(command)) {
+    key += '\0';
+    key += argument;
+  }
+  return key;
+}
+
+uint64_t Preamble::hash(
+    std::string_view groupKey,
+    const std::vector<std::string>& includes) {
+  // The size of each string is hashed too, so that they cannot run into each
+  // other.
+  auto hash = Hash::hash(groupKey.data(), groupKey.size(), 0);
+  for (const auto& include : includes) {
+    hash = Hash::hash(include.data(), include.size(), hash);
+  }
+  return hash;
+}
+
+// Writes the precompiled header to a given file, whatever the command says.
+class BuildAction : public clang::GeneratePCHAction {
+ public:
+  explicit BuildAction(std::string output) : output(std::move(output)) {}
+
+ protected:
+  bool BeginInvocation(clang::CompilerInstance& CI) override {
+    CI.getFrontendOpts().OutputFile = output;
+    return clang::GeneratePCHAction::BeginInvocation(CI);
+  }
+
+ private:
+  const std::string output;
+};
+
+bool Preamble::build(
+    const clang::tooling::CompileCommand& command,
+    const std::vector<std::string>& includes,
+    const std::string& output,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fileSystem) {
+  const auto header = output + ".h";
+  {
+    std::ofstream out(header, std::ios::trunc);
+    for (const auto& include : includes) {
+      out << include << "\n";
+    }
+    if (!out.good()) {
+      return false;
+    }
+  }
+
+  // Quoted includes are looked up next to the files, not the header.
+  auto arguments = getArguments(command);
+  const auto directory =
+      (fs::path(command.Directory) / command.Filename).parent_path();
+  arguments.insert(
+      arguments.end(), {"-iquote", directory.string(), "-x", "c++-header"});
+  const clang::tooling::FixedCompilationDatabase database(
+      command.Directory, arguments);
+
+  class Factory : public clang::tooling::FrontendActionFactory {
+   public:
+    explicit Factory(const std::string& output) : output(output) {}
+
+    std::unique_ptr<clang::FrontendAction> create() override {
+      return std::make_unique<BuildAction>(output);
+    }
+
+   private:
+    const std::string& output;
+  };
+
+  clang::tooling::ClangTool tool(
+      database,
+      {header},
+      std::make_shared<clang::PCHContainerOperations>(),
+      std::move(fileSystem));
+  Factory factory(output);
+  return tool.run(&factory) == 0;
+}
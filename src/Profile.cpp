@@ -14,100 +14,176 @@
 
 #include "propellint/Profile.h"
 
-bool isOperatorBracket(std::string_view entry) {
-  return std::unordered_set<std::string_view>(
-             {
-                 "std::map::operator[]",
-                 "std::unordered_map::operator[]",
-                 "folly::sorted_vector_map::operator[]",
-                 "folly::f14::detail::F14BasicMap::operator[]",
-                 "facebook::multifeed::QuickHashMap::operator[]",
-                 "facebook::datastruct::FBHashMap::operator[]",
-             })
-      .contains(entry);
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <omp.h>
+
+#include <propellint/Trace.h>
+
+uint32_t Profile::SymbolTable::intern(std::string_view symbol) {
+  const auto it = ids.find(symbol);
+  if (it != ids.end()) {
+    return it->second;
+  }
+
+  // The first symbol needs a block even if it is empty.
+  if (blocks.empty() || symbol.size() > kBlockSize - blockOffset) {
+    blocks.push_back(
+        std::make_unique<char[]>(std::max(kBlockSize, symbol.size())));
+    blockOffset = 0;
+  }
+  auto* data = blocks.back().get() + blockOffset;
+  std::copy(symbol.begin(), symbol.end(), data);
+  blockOffset += symbol.size();
+
+  const uint32_t id = symbols.size();
+  symbols.emplace_back(data, symbol.size());
+  ids.emplace(symbols.back(), id);
+  return id;
 }
 
-std::size_t getOperatorBracketIndex(
-    const std::vector<Profile::StackEntry>& stack) {
-  for (int i = 0; i < stack.size(); ++i) {
-    if (isOperatorBracket(stack[i].function)) {
-      return i;
+uint32_t Profile::SymbolTable::adopt(
+    std::string_view symbol,
+    const std::shared_ptr<const void>& storage) {
+  const auto [it, inserted] = ids.try_emplace(symbol, symbols.size());
+  if (inserted) {
+    symbols.push_back(symbol);
+    if (storages.empty() || storages.back() != storage) {
+      storages.push_back(storage);
     }
   }
-
-  return -1;
+  return it->second;
 }
 
-bool isInsertStack(
-    const std::vector<Profile::StackEntry>& stack,
-    std::size_t index) {
-  assert(getOperatorBracketIndex(stack) == index);
-  const auto function = stack[index].function;
+std::optional<uint32_t> Profile::SymbolTable::find(
+    std::string_view symbol) const {
+  const auto it = ids.find(symbol);
+  if (it == ids.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
 
-  if (function == "std::map::operator[]") {
-    return std::find_if(
-               stack.begin() + index + 1, stack.end(), [](const auto& entry) {
-                 return entry.function ==
-                     "std::_Rb_tree::_M_emplace_hint_unique";
-               }) != stack.end();
+void Profile::Locations::add(
+    uint32_t filename,
+    int line,
+    const Weights& siteWeights) {
+  const auto [it, inserted] =
+      index.try_emplace(getKey(filename, line), sites.size());
+  if (inserted) {
+    sites.emplace_back(filename, line);
+    weights.emplace_back(0, 0);
   }
+  weights[it->second].first += siteWeights.first;
+  weights[it->second].second += siteWeights.second;
+}
 
-  if (function == "std::unordered_map::operator[]") {
-    return std::find_if(
-               stack.begin() + index + 1, stack.end(), [](const auto& entry) {
-                 return std::unordered_set<std::string_view>(
-                            {"std::_Hashtable::_Scoped_node::_Scoped_node",
-                             "std::_Hashtable::_M_insert_unique_node"})
-                     .contains(entry.function);
-               }) != stack.end();
+void Profile::Locations::merge(const Locations& other) {
+  std::vector<uint32_t> filenameIds(other.filenames.size());
+  for (uint32_t i = 0; i < filenameIds.size(); ++i) {
+    filenameIds[i] = filenames.intern(other.filenames[i]);
   }
 
-  if (function == "folly::sorted_vector_map::operator[]") {
-    return std::find_if(
-               stack.begin() + index + 1, stack.end(), [](const auto& entry) {
-                 return entry.function == "folly::sorted_vector_map::insert";
-               }) != stack.end();
+  for (uint32_t i = 0; i < other.size(); ++i) {
+    const auto& [filename, line] = other.sites[i];
+    add(filenameIds[filename], line, other.weights[i]);
   }
+}
 
-  if (function == "folly::f14::detail::F14BasicMap::operator[]") {
-    return std::find_if(
-               stack.begin() + index + 1, stack.end(), [](const auto& entry) {
-                 return std::unordered_set<std::string_view>(
-                            {"folly::f14::detail::F14Table::reserveForInsert",
-                             "folly::f14::detail::F14Table::insertAtBlank"})
-                     .contains(entry.function);
-               }) != stack.end();
+const Profile::Locations::Weights* Profile::Locations::find(
+    const CallSite& site) const {
+  const auto filename = filenames.find(site.first);
+  if (!filename.has_value()) {
+    return nullptr;
   }
 
-  if (function == "facebook::multifeed::QuickHashMap::operator[]") {
-    return std::find_if(stack.begin() + index + 1, stack.end(), [](const auto& entry) {
-             return std::unordered_set<std::string_view>(
-                        {"facebook::multifeed::detail::QuickHashTable::growSize",
-                         "facebook::multifeed::detail::QuickHashTable::EntryImpl::EntryImpl"})
-                 .contains(entry.function);
-           }) != stack.end();
+  const auto it = index.find(getKey(filename.value(), site.second));
+  if (it == index.end()) {
+    return nullptr;
   }
+  return &weights[it->second];
+}
 
-  if (function == "facebook::datastruct::FBHashMap::operator[]") {
-    return std::find_if(
-               stack.begin() + index + 1, stack.end(), [](const auto& entry) {
-                 return entry.function ==
-                     "facebook::datastruct::FBHashMap::append_";
-               }) != stack.end();
+const Profile::Locations::Weights& Profile::Locations::at(
+    const CallSite& site) const {
+  const auto* siteWeights = find(site);
+  if (siteWeights == nullptr) {
+    throw std::out_of_range("Unknown call site.");
   }
+  return *siteWeights;
+}
 
-  throw "This should never happen.";
+void Profile::Locations::reserve(std::size_t size) {
+  sites.reserve(size);
+  weights.reserve(size);
+  index.reserve(size);
 }
 
-// No false-positives, minimal false-negatives.
-bool isInsertStack(const std::vector<Profile::StackEntry>& stack) {
-  const auto index = getOperatorBracketIndex(stack);
-  assert(index != -1);
-  return isInsertStack(stack, index);
+std::vector<Profile::CallSite> Profile::Locations::getCallSites() const {
+  std::vector<CallSite> callSites;
+  callSites.reserve(size());
+  for (uint32_t i = 0; i < size(); ++i) {
+    callSites.push_back(getCallSite(i));
+  }
+  return callSites;
+}
+
+// Prefilter on the raw bytes of a record: returns false if none of its frames
+// is a known operator[], so the record does not need to be parsed. Frames are
+// matched on their unescaped bytes, which is fine since no signature contains a
+// character that JSON escapes. If frames are to be normalized, raw frames, e.g.
+// with template arguments, parameters or a suffix, are normalized first.
+bool mayContainOperatorBracket(
+    std::string_view record,
+    const Signatures::Table& signatures,
+    bool normalizeFrames) {
+  static constexpr std::string_view kNeedle = "operator[]";
+
+  const auto* first = record.data();
+  const auto* last = first + record.size();
+  for (auto it = first;;) {
+    it = static_cast<const char*>(
+        memmem(it, last - it, kNeedle.data(), kNeedle.size()));
+    if (it == nullptr) {
+      return false;
+    }
+
+    // The function ends at its location, or at the end of the frame.
+    auto* end = it + kNeedle.size();
+    if (normalizeFrames) {
+      while (end != last && *end != '@' && *end != '"') {
+        ++end;
+      }
+    }
+    if (end != last && (*end == '@' || *end == '"')) {
+      auto begin = it;
+      while (begin != first && begin[-1] != '"') {
+        --begin;
+      }
+      const auto function = std::string_view(begin, end - begin);
+      if (signatures.find(function).kind ==
+              Signatures::Kind::OperatorBracket ||
+          (normalizeFrames &&
+           signatures.find(Profile::normalizeFunction(function)).kind ==
+               Signatures::Kind::OperatorBracket)) {
+        return true;
+      }
+    }
+    it += kNeedle.size();
+  }
 }
 
-Profile::StackEntry parseProfileEntry(std::string_view entry) {
+Profile::StackEntry Profile::parseProfileEntry(std::string_view entry) {
   const auto i = entry.find("@");
+  // Frames without a location, e.g. from folded stacks.
+  if (i == std::string_view::npos) {
+    return {entry, {}, -1};
+  }
   const auto j = entry.find(":", i + 1);
 
   const auto fn = entry.substr(0, i);
@@ -115,59 +191,719 @@ Profile::StackEntry parseProfileEntry(std::string_view entry) {
 
   int line = -1;
   if (j != std::string_view::npos) {
-    line = std::stoi(std::string(entry.substr(j + 1)));
+    std::from_chars(entry.data() + j + 1, entry.data() + entry.size(), line);
   }
 
   return {fn, filename, line};
 }
 
-std::unordered_map<Profile::CallSite, std::pair<uint64_t, uint64_t>>
-Profile::getOperatorBracketLocations(
-    json::ondemand::parser& parser,
-    const json::padded_string& json) {
-  json::ondemand::document profile = parser.iterate(json);
-  std::unordered_map<Profile::CallSite, std::pair<uint64_t, uint64_t>>
-      operatorBracketLocations;
+uint32_t Profile::FoldedStacks::getFrameId(std::string_view entry) {
+  const auto id = entries.intern(entry);
+  if (id == frames.size()) {
+    const auto parsed = parseProfileEntry(entry);
+    frames.push_back(
+        {functions.intern(parsed.function),
+         filenames.intern(parsed.filename),
+         parsed.line});
+  }
+  return id;
+}
+
+uint32_t Profile::FoldedStacks::getFrameId(
+    std::string_view function,
+    std::string_view filename,
+    int line) {
+  scratch.assign(function);
+  scratch += '@';
+  scratch += filename;
+  if (line != -1) {
+    scratch += ':';
+    scratch += std::to_string(line);
+  }
+  return getFrameId(scratch);
+}
 
-  for (auto profileEntry : profile.get_array()) {
-    std::vector<Profile::StackEntry> stack;
-    for (std::string_view entry : profileEntry["stack_combined"]) {
-      stack.push_back(parseProfileEntry(entry));
+uint64_t Profile::FoldedStacks::hash(std::span<const uint32_t> stack) {
+  uint64_t seed = stack.size();
+  for (const auto frame : stack) {
+    seed = (seed ^ frame) * 0x9e3779b97f4a7c15;
+    seed ^= seed >> 32;
+  }
+  return seed;
+}
+
+void Profile::FoldedStacks::grow() {
+  slots.assign(std::max<std::size_t>(16, 2 * slots.size()), 0);
+  const auto mask = slots.size() - 1;
+  for (uint32_t id = 0; id < hashes.size(); ++id) {
+    auto i = hashes[id] & mask;
+    while (slots[i] != 0) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = id + 1;
+  }
+}
+
+void Profile::FoldedStacks::add(
+    std::span<const uint32_t> stack,
+    uint64_t weight) {
+  // Keep the load factor below 1/2.
+  if (2 * (size() + 1) > slots.size()) {
+    grow();
+  }
+
+  const auto stackHash = hash(stack);
+  const auto mask = slots.size() - 1;
+  auto i = stackHash & mask;
+  for (; slots[i] != 0; i = (i + 1) & mask) {
+    const auto id = slots[i] - 1;
+    if (hashes[id] == stackHash && std::ranges::equal(getStack(id), stack)) {
+      weights[id] += weight;
+      return;
+    }
+  }
+
+  slots[i] = size() + 1;
+  stackFrames.insert(stackFrames.end(), stack.begin(), stack.end());
+  stackOffsets.push_back(stackFrames.size());
+  hashes.push_back(stackHash);
+  weights.push_back(weight);
+}
+
+void Profile::FoldedStacks::merge(const FoldedStacks& other) {
+  std::vector<uint32_t> frameIds(other.frames.size());
+  for (uint32_t i = 0; i < frameIds.size(); ++i) {
+    frameIds[i] = getFrameId(other.entries[i]);
+  }
+
+  std::vector<uint32_t> stack;
+  for (uint32_t id = 0; id < other.size(); ++id) {
+    stack.clear();
+    for (const auto frame : other.getStack(id)) {
+      stack.push_back(frameIds[frame]);
+    }
+    add(stack, other.getWeight(id));
+  }
+}
+
+bool isIdentifier(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+// Returns the index past the bracket matching the one at `i`.
+std::size_t skipBalanced(std::string_view function, std::size_t i) {
+  int depth = 0;
+  for (; i < function.size(); ++i) {
+    switch (function[i]) {
+      case '<':
+      case '(':
+      case '[':
+      case '{':
+        ++depth;
+        break;
+      case '>':
+      case ')':
+      case ']':
+      case '}':
+        if (--depth == 0) {
+          return i + 1;
+        }
+        break;
+    }
+  }
+  return function.size();
+}
+
+// Returns the index of the next top-level "::", or the end.
+std::size_t findScope(std::string_view function, std::size_t i) {
+  while (i < function.size()) {
+    if (function.substr(i).starts_with("::")) {
+      return i;
+    }
+    const auto c = function[i];
+    i = c == '<' || c == '(' || c == '[' || c == '{'
+        ? skipBalanced(function, i)
+        : i + 1;
+  }
+  return function.size();
+}
+
+// Returns the index past the name of an operator, starting after "operator".
+std::size_t findOperatorEnd(std::string_view function, std::size_t i) {
+  if (function.substr(i).starts_with("()") ||
+      function.substr(i).starts_with("[]")) {
+    return i + 2;
+  }
+
+  if (i < function.size() && function[i] == ' ') {
+    // "new", "delete" or a conversion, which ends at its parameters.
+    const auto name = function.substr(i + 1);
+    for (const auto keyword : {"new[]", "delete[]", "new", "delete"}) {
+      if (name.starts_with(keyword)) {
+        return i + 1 + std::string_view(keyword).size();
+      }
+    }
+    while (i < function.size() && function[i] != '(') {
+      i = function[i] == '<' ? skipBalanced(function, i) : i + 1;
+    }
+    return i;
+  }
+
+  static constexpr std::string_view kSymbols = "+-*/%^&|~!=<>,";
+  const auto end = std::min(i + 3, function.size());
+  while (i < end && kSymbols.find(function[i]) != std::string_view::npos) {
+    ++i;
+  }
+  return i;
+}
+
+std::string Profile::normalizeFunction(std::string_view function) {
+  static constexpr std::string_view kOperator = "operator";
+  static constexpr std::string_view kAnonymous = "(anonymous namespace)";
+
+  std::string normalized;
+  std::size_t i = 0;
+  while (i < function.size()) {
+    const auto rest = function.substr(i);
+    if (rest.starts_with(kOperator) &&
+        (i == 0 || !isIdentifier(function[i - 1])) &&
+        (rest.size() == kOperator.size() ||
+         !isIdentifier(rest[kOperator.size()]))) {
+      const auto end = findOperatorEnd(function, i + kOperator.size());
+      normalized += function.substr(i, end - i);
+      i = end;
+      continue;
+    }
+    if (rest.starts_with(kAnonymous)) {
+      normalized += kAnonymous;
+      i += kAnonymous.size();
+      continue;
+    }
+
+    switch (function[i]) {
+      case '<':
+      case '[':
+        // Template arguments, ABI tags and clone suffixes.
+        i = skipBalanced(function, i);
+        break;
+      case '(':
+      case '.':
+      case '@':
+        // Parameters and qualifiers, "(inlined)" markers, ".cold" suffixes and
+        // symbol versions, up to a local entity if any.
+        i = findScope(function, i);
+        break;
+      case '{': {
+        // Lambdas and other unnamed entities are kept as they are.
+        const auto end = skipBalanced(function, i);
+        normalized += function.substr(i, end - i);
+        i = end;
+        break;
+      }
+      case ' ': {
+        // A space before the name separates a return type.
+        ++i;
+        const auto next = function.substr(i);
+        if (next.empty() || next.starts_with('<') || next.starts_with('[') ||
+            (next.starts_with('(') && !next.starts_with(kAnonymous))) {
+          break;
+        }
+        normalized.clear();
+        break;
+      }
+      default:
+        normalized += function[i++];
+    }
+  }
+  return normalized;
+}
+
+Profile::FoldedStacks Profile::normalizeFrames(const FoldedStacks& stacks) {
+  const auto& functions = stacks.getFunctions();
+  std::vector<std::string> normalized(functions.size());
+  for (uint32_t i = 0; i < functions.size(); ++i) {
+    normalized[i] = normalizeFunction(functions[i]);
+  }
+
+  FoldedStacks result;
+  std::vector<uint32_t> frameIds(stacks.getFrameCount());
+  for (uint32_t i = 0; i < frameIds.size(); ++i) {
+    const auto& frame = stacks.getFrame(i);
+    frameIds[i] = result.getFrameId(
+        normalized[frame.function],
+        stacks.getFilenames()[frame.filename],
+        frame.line);
+  }
+
+  std::vector<uint32_t> stack;
+  for (uint32_t id = 0; id < stacks.size(); ++id) {
+    stack.clear();
+    for (const auto frame : stacks.getStack(id)) {
+      stack.push_back(frameIds[frame]);
     }
+    result.add(stack, stacks.getWeight(id));
+  }
+  return result;
+}
 
+std::size_t getOperatorBracketIndex(
+    const std::vector<uint32_t>& stack,
+    const std::vector<Signatures::Frame>& signatures) {
+  for (int i = 0; i < stack.size(); ++i) {
+    if (signatures[stack[i]].kind == Signatures::Kind::OperatorBracket) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// No false-positives, minimal false-negatives.
+bool Profile::isInsertStack(
+    const std::vector<uint32_t>& stack,
+    std::size_t index,
+    const std::vector<Signatures::Frame>& frameSignatures,
+    const Signatures::Table& signatures) {
+  assert(getOperatorBracketIndex(stack, frameSignatures) == index);
+  const auto& operatorBracket = frameSignatures[stack[index]];
+
+  return std::find_if(
+             stack.begin() + index + 1, stack.end(), [&](const auto frame) {
+               return signatures.isInsert(
+                   operatorBracket, frameSignatures[frame]);
+             }) != stack.end();
+}
+
+Profile::Locations Profile::getOperatorBracketLocations(
+    const FoldedStacks& stacks,
+    const Signatures::Table& signatures) {
+  Trace::Span span("Classify stacks", "profile");
+  span.addArgument("stacks", stacks.size());
+  // Classify every distinct function once.
+  const auto& functions = stacks.getFunctions();
+  std::vector<Signatures::Frame> functionSignatures(functions.size());
+  for (uint32_t i = 0; i < functions.size(); ++i) {
+    functionSignatures[i] = signatures.find(functions[i]);
+  }
+  std::vector<Signatures::Frame> frameSignatures(stacks.getFrameCount());
+  for (uint32_t i = 0; i < frameSignatures.size(); ++i) {
+    frameSignatures[i] = functionSignatures[stacks.getFrame(i).function];
+  }
+
+  Locations operatorBracketLocations;
+  auto& filenames = operatorBracketLocations.getFilenames();
+  std::vector<uint32_t> filenameIds(stacks.getFilenames().size());
+  for (uint32_t i = 0; i < filenameIds.size(); ++i) {
+    filenameIds[i] = filenames.intern(stacks.getFilenames()[i]);
+  }
+
+  std::vector<uint32_t> stack;
+  for (uint32_t id = 0; id < stacks.size(); ++id) {
     // Remove thrift indirection.
-    std::erase_if(stack, [](const auto& entry) {
-      return entry.function == "apache::thrift::field_ref::operator[]";
-    });
+    stack.clear();
+    for (const auto frame : stacks.getStack(id)) {
+      if (frameSignatures[frame].kind != Signatures::Kind::Transparent) {
+        stack.push_back(frame);
+      }
+    }
 
-    const auto i = getOperatorBracketIndex(stack);
+    const auto i = getOperatorBracketIndex(stack, frameSignatures);
     if (i == 0 || i == -1) {
       continue;
     }
-    const auto caller = stack[i - 1];
-    const CallSite location(caller.filename, caller.line);
+    const auto& caller = stacks.getFrame(stack[i - 1]);
+    const auto weight = stacks.getWeight(id);
+    const auto isInsert = isInsertStack(stack, i, frameSignatures, signatures);
+    operatorBracketLocations.add(
+        filenameIds[caller.filename],
+        caller.line,
+        {isInsert ? weight : 0, weight});
+  }
+
+  span.addArgument("locations", operatorBracketLocations.size());
+  return operatorBracketLocations;
+}
+
+// Per-thread state of the ingestion.
+struct Ingestion {
+  json::ondemand::parser parser;
+  Profile::FoldedStacks stacks;
+  std::vector<uint32_t> stack;
+};
+
+// Folds every record of a (sub-)profile.
+void addProfileEntries(
+    json::ondemand::document& profile,
+    Ingestion& ingestion) {
+  auto& stack = ingestion.stack;
+  for (auto profileEntry : profile.get_array()) {
+    stack.clear();
+    for (std::string_view entry : profileEntry["stack_combined"]) {
+      stack.push_back(ingestion.stacks.getFrameId(entry));
+    }
+    ingestion.stacks.add(stack, uint64_t(profileEntry["total_weight"]));
+  }
+}
+
+// Parallel ingestion.
+// The profile is cut into byte partitions of roughly equal size. A first
+// parallel pass summarizes each partition (quote parity and nesting depth), so
+// that every partition knows whether it starts inside a string and at which
+// depth without a serial scan of the whole file. Each worker then collects the
+// records that start in its partition, copies them into a standalone JSON array
+// and parses it with its own parser.
+
+// simdjson cannot parse documents larger than 4GB, so we keep chunks smaller.
+constexpr std::size_t kMaxChunkSize = std::size_t(1) << 30;
+
+struct PartitionSummary {
+  std::size_t quotes = 0;
+  // Depth delta outside of strings, assuming the partition starts outside (0)
+  // or inside (1) a string.
+  int64_t depth[2] = {0, 0};
+};
+
+struct PartitionState {
+  bool inString = false;
+  int64_t depth = 0;
+};
+
+bool isEscaped(const char* quote, const char* first) {
+  auto it = quote;
+  while (it != first && it[-1] == '\\') {
+    --it;
+  }
+  return (quote - it) % 2 == 1;
+}
+
+// Returns the closing quote of the string `it` is in, or `last`.
+const char* findStringEnd(const char* it, const char* first, const char* last) {
+  while (it < last) {
+    it = static_cast<const char*>(std::memchr(it, '"', last - it));
+    if (it == nullptr) {
+      return last;
+    }
+    if (!isEscaped(it, first)) {
+      return it;
+    }
+    ++it;
+  }
+  return last;
+}
+
+PartitionSummary
+summarizePartition(const char* begin, const char* end, const char* first) {
+  PartitionSummary summary;
+  for (auto it = begin; it != end; ++it) {
+    switch (*it) {
+      case '"':
+        if (!isEscaped(it, first)) {
+          ++summary.quotes;
+        }
+        break;
+      case '{':
+      case '[':
+        ++summary.depth[summary.quotes % 2];
+        break;
+      case '}':
+      case ']':
+        --summary.depth[summary.quotes % 2];
+        break;
+    }
+  }
+  return summary;
+}
 
-    if (isInsertStack(stack, i)) {
-      operatorBracketLocations[location].first +=
-          uint64_t(profileEntry["total_weight"]);
+// Calls `callback(begin, end)` for every record starting in [begin, end).
+template <typename Callback>
+void forEachRecord(
+    const char* begin,
+    const char* end,
+    const char* first,
+    const char* last,
+    PartitionState state,
+    int64_t recordDepth,
+    Callback&& callback) {
+  const char* record = nullptr;
+  for (auto it = begin; it < last; ++it) {
+    if (state.inString) {
+      it = findStringEnd(it, first, last);
+      state.inString = false;
+      continue;
     }
 
-    operatorBracketLocations[location].second +=
-        uint64_t(profileEntry["total_weight"]);
+    switch (*it) {
+      case '"':
+        state.inString = true;
+        break;
+      case '{':
+      case '[':
+        if (state.depth == recordDepth) {
+          if (it >= end) {
+            return;
+          }
+          record = it;
+        }
+        ++state.depth;
+        break;
+      case '}':
+      case ']':
+        --state.depth;
+        if (state.depth == recordDepth && record != nullptr) {
+          callback(record, it + 1);
+          record = nullptr;
+        }
+        break;
+    }
   }
+}
 
-  return operatorBracketLocations;
+// Symbols may contain any byte, which <cctype> only takes as unsigned char.
+static bool isSpace(char c) {
+  return std::isspace(static_cast<unsigned char>(c));
+}
+
+// The profile is either a JSON array of records, or newline-delimited JSON.
+std::optional<int64_t> getRecordDepth(std::string_view profile) {
+  const auto start = std::find_if_not(profile.begin(), profile.end(), isSpace);
+  if (start == profile.end()) {
+    return std::nullopt;
+  }
+  return *start == '[' ? 1 : 0;
+}
+
+// Folds the records which start and end in `window`, and returns the end of the
+// last one (or the start of the window if there are none). The window starts
+// in the given state.
+const char* foldWindow(
+    std::string_view window,
+    PartitionState initial,
+    int64_t recordDepth,
+    const Signatures::Table& signatures,
+    bool normalizeFrames,
+    std::vector<Ingestion>& ingestions,
+    Profile::IngestionStatistics& statistics) {
+  const auto jobs = ingestions.size();
+  const auto* first = window.data();
+  const auto* last = first + window.size();
+
+  const auto partitions =
+      std::max(jobs, (window.size() + kMaxChunkSize - 1) / kMaxChunkSize);
+  const auto partitionSize = (window.size() + partitions - 1) / partitions;
+  const auto partitionBegin = [&](std::size_t k) {
+    return first + std::min(window.size(), k * partitionSize);
+  };
+
+  std::vector<PartitionSummary> summaries(partitions);
+#pragma omp parallel for num_threads(jobs)
+  for (std::size_t k = 0; k < partitions; ++k) {
+    summaries[k] =
+        summarizePartition(partitionBegin(k), partitionBegin(k + 1), first);
+  }
+
+  std::vector<PartitionState> states(partitions, initial);
+  for (std::size_t k = 1; k < partitions; ++k) {
+    const auto& previous = states[k - 1];
+    states[k].inString =
+        previous.inString != (summaries[k - 1].quotes % 2 == 1);
+    states[k].depth =
+        previous.depth + summaries[k - 1].depth[previous.inString ? 1 : 0];
+  }
+
+  std::vector<Profile::IngestionStatistics> partialStatistics(partitions);
+  std::vector<const char*> ends(partitions, first);
+
+#pragma omp parallel for schedule(dynamic) num_threads(jobs)
+  for (std::size_t k = 0; k < partitions; ++k) {
+    // The main thread is the first OpenMP thread too.
+    if (Trace::isEnabled() && omp_get_thread_num() != 0) {
+      Trace::setThreadName("OpenMP " + std::to_string(omp_get_thread_num()));
+    }
+    Trace::Span span("Fold partition", "profile");
+    auto& partitionStatistics = partialStatistics[k];
+    const auto scanStart = std::chrono::steady_clock::now();
+    std::vector<std::pair<const char*, const char*>> records;
+    std::size_t size = 1;
+    forEachRecord(
+        partitionBegin(k),
+        partitionBegin(k + 1),
+        first,
+        last,
+        states[k],
+        recordDepth,
+        [&](const char* begin, const char* end) {
+          ends[k] = end;
+          ++partitionStatistics.records;
+          partitionStatistics.scannedBytes += end - begin;
+          const auto record = std::string_view(begin, end - begin);
+          if (!mayContainOperatorBracket(
+                  record, signatures, normalizeFrames)) {
+            ++partitionStatistics.skippedRecords;
+            return;
+          }
+          records.emplace_back(begin, end);
+          size += end - begin + 1;
+        });
+    partitionStatistics.scanSeconds =
+        std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - scanStart)
+            .count();
+    span.addArgument("bytes", partitionStatistics.scannedBytes);
+    span.addArgument("records", partitionStatistics.records);
+    span.addArgument("skipped", partitionStatistics.skippedRecords);
+    if (records.empty()) {
+      continue;
+    }
+
+    json::padded_string chunk(size);
+    auto* out = chunk.data();
+    *out++ = '[';
+    for (const auto& [begin, end] : records) {
+      out = std::copy(begin, end, out);
+      *out++ = ',';
+    }
+    out[-1] = ']';
+
+    auto& ingestion = ingestions[omp_get_thread_num()];
+    json::ondemand::document profile = ingestion.parser.iterate(chunk);
+    addProfileEntries(profile, ingestion);
+  }
+
+  for (const auto& partitionStatistics : partialStatistics) {
+    statistics.records += partitionStatistics.records;
+    statistics.skippedRecords += partitionStatistics.skippedRecords;
+    statistics.scannedBytes += partitionStatistics.scannedBytes;
+    statistics.scanSeconds += partitionStatistics.scanSeconds;
+  }
+
+  return *std::max_element(ends.begin(), ends.end());
+}
+
+Profile::FoldedStacks mergeIngestions(
+    std::vector<Ingestion>& ingestions,
+    Profile::IngestionStatistics& statistics) {
+  Trace::Span span("Merge stacks", "profile");
+  auto& stacks = ingestions.front().stacks;
+  for (std::size_t i = 1; i < ingestions.size(); ++i) {
+    stacks.merge(ingestions[i].stacks);
+  }
+  statistics.uniqueStacks = stacks.size();
+  span.addArgument("stacks", stacks.size());
+
+  return std::move(stacks);
+}
+
+Profile::FoldedStacks Profile::getFoldedStacks(
+    const json::padded_string& json,
+    const Signatures::Table& signatures,
+    std::size_t jobs,
+    IngestionStatistics& statistics,
+    bool normalizeFrames) {
+  const auto profile = std::string_view(json.data(), json.size());
+  const auto recordDepth = getRecordDepth(profile);
+  if (!recordDepth.has_value()) {
+    return {};
+  }
+
+  std::vector<Ingestion> ingestions(std::max<std::size_t>(jobs, 1));
+  foldWindow(
+      profile,
+      {},
+      recordDepth.value(),
+      signatures,
+      normalizeFrames,
+      ingestions,
+      statistics);
+  return mergeIngestions(ingestions, statistics);
+}
+
+Profile::FoldedStacks Profile::getFoldedStacks(
+    const std::string& filename,
+    const Signatures::Table& signatures,
+    std::size_t jobs,
+    std::size_t windowSize,
+    IngestionStatistics& statistics,
+    bool normalizeFrames) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("Could not open " + filename + ".");
+  }
+
+  std::vector<Ingestion> ingestions(std::max<std::size_t>(jobs, 1));
+  std::vector<char> buffer(std::max<std::size_t>(windowSize, 1));
+  std::size_t size = 0;
+  std::optional<int64_t> recordDepth;
+  PartitionState state;
+  while (true) {
+    in.read(buffer.data() + size, buffer.size() - size);
+    size += in.gcount();
+    const auto eof = !in;
+    const auto window = std::string_view(buffer.data(), size);
+
+    if (!recordDepth.has_value()) {
+      recordDepth = getRecordDepth(window);
+      if (!recordDepth.has_value()) {
+        if (eof) {
+          break;
+        }
+        size = 0;
+        continue;
+      }
+    }
+
+    const auto* end = foldWindow(
+        window,
+        state,
+        recordDepth.value(),
+        signatures,
+        normalizeFrames,
+        ingestions,
+        statistics);
+    if (eof) {
+      break;
+    }
+
+    const std::size_t consumed = end - buffer.data();
+    if (consumed == 0) {
+      // A single record is larger than the window.
+      buffer.resize(2 * buffer.size());
+      continue;
+    }
+    // The rest of the window starts between two records.
+    state = {.inString = false, .depth = recordDepth.value()};
+    std::memmove(buffer.data(), end, size - consumed);
+    size -= consumed;
+  }
+
+  return mergeIngestions(ingestions, statistics);
+}
+
+Profile::Locations Profile::getOperatorBracketLocations(
+    const json::padded_string& json,
+    const Signatures::Table& signatures,
+    std::size_t jobs,
+    IngestionStatistics& statistics) {
+  return getOperatorBracketLocations(
+      getFoldedStacks(json, signatures, jobs, statistics), signatures);
 }
 
 // We are not interested in operator[] calls that never insert.
-std::unordered_map<Profile::CallSite, std::pair<uint64_t, uint64_t>>
-Profile::getInsertOperatorBracketLocations(
-    json::ondemand::parser& parser,
-    const json::padded_string& json) {
-  auto locations = Profile::getOperatorBracketLocations(parser, json);
-  std::erase_if(locations, [](const auto& location) {
-    return location.second.first == 0;
-  });
-
-  return locations;
+Profile::Locations Profile::getInsertOperatorBracketLocations(
+    const Locations& locations) {
+  Locations insertLocations;
+  for (uint32_t i = 0; i < locations.size(); ++i) {
+    if (locations.getWeights(i).first != 0) {
+      insertLocations.add(locations.getCallSite(i), locations.getWeights(i));
+    }
+  }
+  return insertLocations;
+}
+
+Profile::Locations Profile::getInsertOperatorBracketLocations(
+    const json::padded_string& json,
+    const Signatures::Table& signatures,
+    std::size_t jobs,
+    IngestionStatistics& statistics) {
+  return getInsertOperatorBracketLocations(
+      getOperatorBracketLocations(json, signatures, jobs, statistics));
 }
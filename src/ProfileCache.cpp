@@ -0,0 +1,399 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/ProfileCache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include <propellint/Hash.h>
+
+// Bump whenever the layout below changes.
+constexpr uint32_t kMagic = 0x43504c50; // "PLPC"
+constexpr uint32_t kFormatVersion = 2;
+
+// Hashing is done per block, so the hash does not depend on the number of
+// threads.
+constexpr std::size_t kHashBlockSize = std::size_t(64) << 20;
+
+struct Header {
+  uint32_t magic;
+  uint32_t formatVersion;
+  uint64_t sourceSize;
+  int64_t sourceMtime;
+  uint64_t sourceHash;
+  uint64_t signaturesVersion;
+  uint64_t normalizedFrames;
+  uint64_t hasStacks;
+};
+
+// A read-only memory mapping of a whole file.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filename) {
+    const auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) == 0 && status.st_size > 0) {
+      auto* mapping =
+          mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping != MAP_FAILED) {
+        data = static_cast<const char*>(mapping);
+        size = status.st_size;
+      }
+    }
+    close(fd);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (data != nullptr) {
+      munmap(const_cast<char*>(data), size);
+    }
+  }
+
+  const char* data = nullptr;
+  std::size_t size = 0;
+};
+
+ProfileCache::Source ProfileCache::getSource(
+    const std::string& filename,
+    std::size_t jobs) {
+  struct stat status;
+  if (stat(filename.c_str(), &status) != 0) {
+    throw std::runtime_error("Could not stat " + filename + ".");
+  }
+
+  Source source;
+  source.size = status.st_size;
+  source.mtime =
+      int64_t(status.st_mtim.tv_sec) * 1'000'000'000 + status.st_mtim.tv_nsec;
+
+  const MappedFile file(filename);
+  const auto blocks = (file.size + kHashBlockSize - 1) / kHashBlockSize;
+  std::vector<uint64_t> hashes(blocks);
+#pragma omp parallel for num_threads(std::max<std::size_t>(jobs, 1))
+  for (std::size_t i = 0; i < blocks; ++i) {
+    const auto offset = i * kHashBlockSize;
+    hashes[i] = Hash::hash(
+        file.data + offset, std::min(kHashBlockSize, file.size - offset), i);
+  }
+  source.hash = Hash::hash(
+      reinterpret_cast<const char*>(hashes.data()),
+      hashes.size() * sizeof(uint64_t),
+      source.size);
+
+  return source;
+}
+
+// Writes arrays aligned on 8 bytes, so they can be used in place once mapped.
+class Writer {
+ public:
+  explicit Writer(const std::string& filename)
+      : out(filename, std::ios::binary | std::ios::trunc) {}
+
+  template <typename T>
+  void write(const T& value) {
+    write(std::span<const T>(&value, 1));
+  }
+
+  template <typename T>
+  void write(std::span<const T> values) {
+    const uint64_t size = values.size();
+    writeRaw(&size, sizeof(size));
+    writeRaw(values.data(), values.size_bytes());
+  }
+
+  void write(const Profile::SymbolTable& symbols) {
+    std::vector<uint64_t> offsets = {0};
+    for (uint32_t i = 0; i < symbols.size(); ++i) {
+      offsets.push_back(offsets.back() + symbols[i].size());
+    }
+    write(std::span<const uint64_t>(offsets));
+    for (uint32_t i = 0; i < symbols.size(); ++i) {
+      out.write(symbols[i].data(), symbols[i].size());
+    }
+    pad(offsets.back());
+  }
+
+  bool close() {
+    out.close();
+    return out.good();
+  }
+
+ private:
+  void writeRaw(const void* data, std::size_t size) {
+    out.write(static_cast<const char*>(data), size);
+    pad(size);
+  }
+
+  void pad(std::size_t size) {
+    static constexpr char kZeros[8] = {};
+    out.write(kZeros, (8 - size % 8) % 8);
+  }
+
+  std::ofstream out;
+};
+
+// Reads what Writer wrote, checking bounds. Arrays are views into the mapping.
+class Reader {
+ public:
+  Reader(const char* data, std::size_t size) : it(data), last(data + size) {}
+
+  template <typename T>
+  T read() {
+    const auto values = readArray<T>();
+    if (values.size() != 1) {
+      throw std::runtime_error("Corrupted profile cache.");
+    }
+    return values.front();
+  }
+
+  template <typename T>
+  std::span<const T> readArray() {
+    uint64_t size;
+    readRaw(&size, sizeof(size));
+    // The size may be corrupted, and overflow once multiplied.
+    if (size > std::size_t(last - it) / sizeof(T)) {
+      throw std::runtime_error("Corrupted profile cache.");
+    }
+    const auto* values = reinterpret_cast<const T*>(skip(size * sizeof(T)));
+    return {values, size};
+  }
+
+  std::vector<std::string_view> readSymbols() {
+    const auto offsets = readArray<uint64_t>();
+    if (offsets.empty()) {
+      throw std::runtime_error("Corrupted profile cache.");
+    }
+    const auto* blob = skip(offsets.back());
+
+    std::vector<std::string_view> symbols;
+    for (std::size_t i = 0; i + 1 < offsets.size(); ++i) {
+      if (offsets[i] > offsets[i + 1]) {
+        throw std::runtime_error("Corrupted profile cache.");
+      }
+      symbols.emplace_back(blob + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    return symbols;
+  }
+
+ private:
+  void readRaw(void* data, std::size_t size) {
+    std::memcpy(data, skip(size), size);
+  }
+
+  const char* skip(std::size_t size) {
+    if (size > std::size_t(last - it)) {
+      throw std::runtime_error("Corrupted profile cache.");
+    }
+    const auto padded = size + (8 - size % 8) % 8;
+    if (padded > std::size_t(last - it)) {
+      throw std::runtime_error("Corrupted profile cache.");
+    }
+    const auto* data = it;
+    it += padded;
+    return data;
+  }
+
+  const char* it;
+  const char* last;
+};
+
+template <typename T>
+void checkSize(std::span<const T> values, std::size_t size) {
+  if (values.size() != size) {
+    throw std::runtime_error("Corrupted profile cache.");
+  }
+}
+
+std::optional<ProfileCache::Content> ProfileCache::load(
+    const std::string& filename,
+    const Source& source,
+    const Signatures::Table& signatures) {
+  const auto file = std::make_shared<const MappedFile>(filename);
+  if (file->data == nullptr) {
+    return std::nullopt;
+  }
+
+  try {
+    Reader reader(file->data, file->size);
+    const auto header = reader.read<Header>();
+    if (header.magic != kMagic || header.formatVersion != kFormatVersion ||
+        header.sourceSize != source.size ||
+        header.sourceMtime != source.mtime ||
+        header.sourceHash != source.hash ||
+        header.signaturesVersion != signatures.getVersion() ||
+        header.normalizedFrames != source.normalizedFrames) {
+      return std::nullopt;
+    }
+
+    Content content;
+    const auto filenames = reader.readSymbols();
+    const auto siteFilenames = reader.readArray<uint32_t>();
+    const auto lines = reader.readArray<int32_t>();
+    const auto insertWeights = reader.readArray<uint64_t>();
+    const auto totalWeights = reader.readArray<uint64_t>();
+    checkSize(lines, siteFilenames.size());
+    checkSize(insertWeights, siteFilenames.size());
+    checkSize(totalWeights, siteFilenames.size());
+    // Filenames are used in place, only the index of the sites is rebuilt.
+    auto& locationFilenames = content.locations.getFilenames();
+    std::vector<uint32_t> filenameIds;
+    for (const auto filename : filenames) {
+      filenameIds.push_back(locationFilenames.adopt(filename, file));
+    }
+    content.locations.reserve(siteFilenames.size());
+    for (std::size_t i = 0; i < siteFilenames.size(); ++i) {
+      content.locations.add(
+          filenameIds.at(siteFilenames[i]),
+          lines[i],
+          {insertWeights[i], totalWeights[i]});
+    }
+
+    if (header.hasStacks) {
+      auto& stacks = content.stacks.emplace();
+      const auto functions = reader.readSymbols();
+      const auto stackFilenames = reader.readSymbols();
+      const auto frameFunctions = reader.readArray<uint32_t>();
+      const auto frameFilenames = reader.readArray<uint32_t>();
+      const auto frameLines = reader.readArray<int32_t>();
+      const auto offsets = reader.readArray<uint64_t>();
+      const auto frames = reader.readArray<uint32_t>();
+      const auto weights = reader.readArray<uint64_t>();
+      checkSize(frameFilenames, frameFunctions.size());
+      checkSize(frameLines, frameFunctions.size());
+      checkSize(offsets, weights.size() + 1);
+
+      std::vector<uint32_t> frameIds;
+      for (std::size_t i = 0; i < frameFunctions.size(); ++i) {
+        frameIds.push_back(stacks.getFrameId(
+            functions.at(frameFunctions[i]),
+            stackFilenames.at(frameFilenames[i]),
+            frameLines[i]));
+      }
+
+      std::vector<uint32_t> stack;
+      for (std::size_t i = 0; i < weights.size(); ++i) {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > frames.size()) {
+          throw std::runtime_error("Corrupted profile cache.");
+        }
+        stack.clear();
+        for (auto j = offsets[i]; j < offsets[i + 1]; ++j) {
+          stack.push_back(frameIds.at(frames[j]));
+        }
+        stacks.add(stack, weights[i]);
+      }
+    }
+
+    return content;
+  } catch (const std::exception& exception) {
+    std::cerr << "Ignoring profile cache " << filename << ": "
+              << exception.what() << std::endl;
+    return std::nullopt;
+  }
+}
+
+void ProfileCache::save(
+    const std::string& filename,
+    const Source& source,
+    const Signatures::Table& signatures,
+    const Profile::Locations& locations,
+    const Profile::FoldedStacks* stacks) {
+  // Write to a temporary file first, so readers never see a partial cache.
+  const auto temporary = filename + ".tmp";
+  Writer writer(temporary);
+  writer.write(Header{
+      .magic = kMagic,
+      .formatVersion = kFormatVersion,
+      .sourceSize = source.size,
+      .sourceMtime = source.mtime,
+      .sourceHash = source.hash,
+      .signaturesVersion = signatures.getVersion(),
+      .normalizedFrames = source.normalizedFrames,
+      .hasStacks = stacks != nullptr,
+  });
+
+  Profile::SymbolTable filenames;
+  std::vector<uint32_t> siteFilenames;
+  std::vector<int32_t> lines;
+  std::vector<uint64_t> insertWeights;
+  std::vector<uint64_t> totalWeights;
+  for (uint32_t i = 0; i < locations.size(); ++i) {
+    const auto [filename, line] = locations.getCallSite(i);
+    siteFilenames.push_back(filenames.intern(filename));
+    lines.push_back(line);
+    insertWeights.push_back(locations.getWeights(i).first);
+    totalWeights.push_back(locations.getWeights(i).second);
+  }
+  writer.write(filenames);
+  writer.write(std::span<const uint32_t>(siteFilenames));
+  writer.write(std::span<const int32_t>(lines));
+  writer.write(std::span<const uint64_t>(insertWeights));
+  writer.write(std::span<const uint64_t>(totalWeights));
+
+  if (stacks != nullptr) {
+    std::vector<uint32_t> frameFunctions;
+    std::vector<uint32_t> frameFilenames;
+    std::vector<int32_t> frameLines;
+    for (uint32_t i = 0; i < stacks->getFrameCount(); ++i) {
+      const auto& frame = stacks->getFrame(i);
+      frameFunctions.push_back(frame.function);
+      frameFilenames.push_back(frame.filename);
+      frameLines.push_back(frame.line);
+    }
+
+    std::vector<uint64_t> offsets = {0};
+    std::vector<uint32_t> frames;
+    std::vector<uint64_t> weights;
+    for (uint32_t i = 0; i < stacks->size(); ++i) {
+      const auto stack = stacks->getStack(i);
+      frames.insert(frames.end(), stack.begin(), stack.end());
+      offsets.push_back(frames.size());
+      weights.push_back(stacks->getWeight(i));
+    }
+
+    writer.write(stacks->getFunctions());
+    writer.write(stacks->getFilenames());
+    writer.write(std::span<const uint32_t>(frameFunctions));
+    writer.write(std::span<const uint32_t>(frameFilenames));
+    writer.write(std::span<const int32_t>(frameLines));
+    writer.write(std::span<const uint64_t>(offsets));
+    writer.write(std::span<const uint32_t>(frames));
+    writer.write(std::span<const uint64_t>(weights));
+  }
+
+  if (!writer.close()) {
+    std::cerr << "Could not write profile cache " << filename << "."
+              << std::endl;
+    std::remove(temporary.c_str());
+    return;
+  }
+  std::rename(temporary.c_str(), filename.c_str());
+}
@@ -0,0 +1,179 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/ResultCache.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
+
+#include <propellint/Hash.h>
+
+namespace fs = std::filesystem;
+
+// The first line of every entry, followed by kVersion.
+static const std::string kMagic = "propellint-result-cache";
+
+static std::optional<std::string> readFile(const std::string& filename) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in) {
+    return std::nullopt;
+  }
+  return std::string(
+      std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static uint64_t hashString(std::string_view data, uint64_t seed) {
+  return Hash::hash(data.data(), data.size(), seed);
+}
+
+ResultCache::Cache::Cache(const std::string& directory)
+    : directory(directory) {
+  fs::create_directories(directory);
+}
+
+std::optional<uint64_t> ResultCache::Cache::getKey(
+    const std::string& filename,
+    const std::string& workingDirectory,
+    const std::vector<std::string>& commandLine,
+    std::string_view engine) {
+  const auto contents = hashFile(filename);
+  if (!contents.has_value()) {
+    return std::nullopt;
+  }
+
+  auto key = hashString(engine, *contents ^ kVersion);
+  key = hashString(filename, key);
+  key = hashString(workingDirectory, key);
+  for (const auto& argument : commandLine) {
+    key = hashString(argument, key);
+  }
+  return key;
+}
+
+std::optional<ResultCache::Entry> ResultCache::Cache::load(uint64_t key) {
+  std::ifstream in(getPath(key));
+  if (!in) {
+    return std::nullopt;
+  }
+
+  std::string magic;
+  uint32_t version;
+  std::size_t dependencyCount;
+  if (!(in >> magic >> version >> dependencyCount) || magic != kMagic ||
+      version != kVersion) {
+    return std::nullopt;
+  }
+
+  Entry entry;
+  for (std::size_t i = 0; i < dependencyCount; ++i) {
+    uint64_t hash;
+    std::string filename;
+    // Filenames run to the end of the line, and may contain spaces.
+    if (!(in >> std::hex >> hash >> std::dec) || !in.ignore(1) ||
+        !std::getline(in, filename)) {
+      return std::nullopt;
+    }
+    if (hashFile(filename) != hash) {
+      return std::nullopt;
+    }
+    entry.dependencies.emplace_back(std::move(filename), hash);
+  }
+
+  std::size_t lineCount;
+  if (!(in >> lineCount)) {
+    return std::nullopt;
+  }
+  for (std::size_t i = 0; i < lineCount; ++i) {
+    Line line;
+    if (!(in >> line.line >> line.matched) || !in.ignore(1) ||
+        !std::getline(in, line.filename)) {
+      return std::nullopt;
+    }
+    entry.lines.push_back(std::move(line));
+  }
+  return entry;
+}
+
+void ResultCache::Cache::save(
+    uint64_t key,
+    const std::string& workingDirectory,
+    const std::vector<std::string>& dependencies,
+    const std::vector<Line>& lines) {
+  std::ostringstream out;
+  out << kMagic << " " << kVersion << " " << dependencies.size() << "\n";
+  for (const auto& dependency : dependencies) {
+    const auto filename =
+        (fs::path(workingDirectory) / dependency).lexically_normal().string();
+    const auto hash = hashFile(filename);
+    if (!hash.has_value()) {
+      return;
+    }
+    out << std::hex << *hash << std::dec << " " << filename << "\n";
+  }
+  out << lines.size() << "\n";
+  for (const auto& line : lines) {
+    out << line.line << " " << line.matched << " " << line.filename << "\n";
+  }
+
+  // Write to a temporary file first, so readers never see a partial entry. Its
+  // name is unique to the thread and the process, since concurrent runs may
+  // share the directory.
+  const auto path = getPath(key);
+  const auto temporary = path + ".tmp" + std::to_string(getpid()) + "." +
+      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  {
+    std::ofstream file(temporary, std::ios::trunc);
+    file << out.str();
+    file.close();
+    if (!file.good()) {
+      std::cerr << "Could not write result cache entry " << path << "."
+                << std::endl;
+      std::remove(temporary.c_str());
+      return;
+    }
+  }
+  std::rename(temporary.c_str(), path.c_str());
+}
+
+std::optional<uint64_t> ResultCache::Cache::hashFile(
+    const std::string& filename) {
+  {
+    const std::lock_guard lock(mutex);
+    const auto hash = hashes.find(filename);
+    if (hash != hashes.end()) {
+      return hash->second;
+    }
+  }
+
+  std::optional<uint64_t> hash;
+  if (const auto contents = readFile(filename)) {
+    hash = hashString(*contents, 0);
+  }
+  const std::lock_guard lock(mutex);
+  hashes.emplace(filename, hash);
+  return hash;
+}
+
+std::string ResultCache::Cache::getPath(uint64_t key) const {
+  char name[17];
+  std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+  return directory + "/" + name;
+}
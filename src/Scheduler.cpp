@@ -0,0 +1,355 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/Scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <propellint/Trace.h>
+
+struct Queue {
+  std::mutex mutex;
+  std::deque<Scheduler::Task> tasks;
+};
+
+std::optional<Scheduler::Task> pop(Queue& queue) {
+  const std::lock_guard lock(queue.mutex);
+  if (queue.tasks.empty()) {
+    return std::nullopt;
+  }
+  const auto task = queue.tasks.front();
+  queue.tasks.pop_front();
+  return task;
+}
+
+// Takes the largest task of the longest queue.
+std::optional<Scheduler::Task> steal(std::vector<Queue>& queues) {
+  while (true) {
+    Queue* victim = nullptr;
+    std::size_t victimSize = 0;
+    for (auto& queue : queues) {
+      const std::lock_guard lock(queue.mutex);
+      if (queue.tasks.size() > victimSize) {
+        victim = &queue;
+        victimSize = queue.tasks.size();
+      }
+    }
+    if (victim == nullptr) {
+      return std::nullopt;
+    }
+    // The victim may have been emptied in the meantime.
+    if (const auto task = pop(*victim)) {
+      return task;
+    }
+  }
+}
+
+// Holds tasks back while the process is over its memory budget. Each running
+// task reserves the largest growth of the resident set size seen during a
+// task, since a task only grows the process once it has started. Until a task
+// has finished, this is unknown and tasks run one at a time. A task is always
+// admitted when none is running, so that progress is made.
+class Admission {
+ public:
+  struct Ticket {
+    // Time waited, in seconds.
+    double waitingSeconds = 0;
+    uint64_t reservedBytes = 0;
+    uint64_t residentBytes = 0;
+  };
+
+  explicit Admission(uint64_t maxMemory) : maxMemory_(maxMemory) {}
+
+  Ticket acquire() {
+    Ticket ticket;
+    if (maxMemory_ == 0) {
+      return ticket;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    // The resident set size is read without holding the lock, so that other
+    // workers are not held back by /proc.
+    ticket.residentBytes = Scheduler::getResidentBytes();
+    std::unique_lock lock(mutex_);
+    while (running_ > 0 && !fits(ticket.residentBytes)) {
+      // The resident set size also shrinks outside of the tasks.
+      released_.wait_for(lock, std::chrono::milliseconds(10));
+      lock.unlock();
+      ticket.residentBytes = Scheduler::getResidentBytes();
+      lock.lock();
+    }
+    ++running_;
+    ticket.reservedBytes = estimatedBytes_.value_or(0);
+    reservedBytes_ += ticket.reservedBytes;
+    ticket.waitingSeconds = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    return ticket;
+  }
+
+  void release(const Ticket& ticket) {
+    if (maxMemory_ == 0) {
+      return;
+    }
+
+    auto residentBytes = Scheduler::getResidentBytes();
+    const auto grownBytes = residentBytes > ticket.residentBytes
+        ? residentBytes - ticket.residentBytes
+        : 0;
+#ifdef __GLIBC__
+    // Freed ASTs are otherwise kept by the allocator and still counted.
+    if (residentBytes >= maxMemory_) {
+      malloc_trim(0);
+    }
+#endif
+    {
+      const std::lock_guard lock(mutex_);
+      --running_;
+      reservedBytes_ -= ticket.reservedBytes;
+      estimatedBytes_ = std::max(estimatedBytes_.value_or(0), grownBytes);
+    }
+    released_.notify_all();
+  }
+
+ private:
+  // Must be called with the lock held.
+  bool fits(uint64_t residentBytes) const {
+    return estimatedBytes_.has_value() &&
+        residentBytes + reservedBytes_ + *estimatedBytes_ < maxMemory_;
+  }
+
+  const uint64_t maxMemory_;
+  std::mutex mutex_;
+  std::condition_variable released_;
+  std::size_t running_ = 0;
+  // Reserved by the running tasks, which the resident set size may not
+  // include yet.
+  uint64_t reservedBytes_ = 0;
+  // Unknown until a task has finished.
+  std::optional<uint64_t> estimatedBytes_;
+};
+
+uint64_t Scheduler::getResidentBytes() {
+  // The second field is the number of resident pages.
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size = 0;
+  uint64_t resident = 0;
+  if (!(statm >> size >> resident)) {
+    return 0;
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+uint64_t Scheduler::getPeakResidentBytes() {
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  // In kilobytes on Linux.
+  return uint64_t(usage.ru_maxrss) << 10;
+}
+
+struct Scheduler::Pool::State {
+  State(
+      std::size_t jobs,
+      std::function<void(std::size_t)> function,
+      uint64_t maxMemory)
+      : function(std::move(function)), queues(jobs), admission(maxMemory) {
+    statistics.workers.resize(jobs);
+  }
+
+  // Returns the next task of the worker, and whether it was stolen, or nothing
+  // once finished.
+  std::optional<std::pair<Task, bool>> take(std::size_t worker) {
+    while (true) {
+      auto task = pop(queues[worker]);
+      const auto stolen = !task.has_value();
+      if (stolen) {
+        task = steal(queues);
+      }
+
+      std::unique_lock lock(mutex);
+      if (task.has_value()) {
+        --queued;
+        ++running;
+        return std::make_pair(*task, stolen);
+      }
+      // Running tasks may still add tasks.
+      const auto done = [this] {
+        return queued <= 0 && finished && running == 0;
+      };
+      added.wait(lock, [&] { return queued > 0 || done(); });
+      if (done()) {
+        return std::nullopt;
+      }
+    }
+  }
+
+  void complete() {
+    {
+      const std::lock_guard lock(mutex);
+      --running;
+      if (running > 0) {
+        return;
+      }
+    }
+    added.notify_all();
+  }
+
+  void work(std::size_t worker) {
+    auto& workerStatistics = statistics.workers[worker];
+    Trace::setThreadName("Worker " + std::to_string(worker));
+    while (const auto next = take(worker)) {
+      const auto& [task, stolen] = *next;
+      if (stolen) {
+        ++workerStatistics.stolenTasks;
+      }
+
+      const auto ticket = admission.acquire();
+      workerStatistics.waitingSeconds += ticket.waitingSeconds;
+      const auto taskStart = std::chrono::steady_clock::now();
+      function(task.id);
+      workerStatistics.busySeconds += std::chrono::duration<double>(
+                                          std::chrono::steady_clock::now() -
+                                          taskStart)
+                                          .count();
+      admission.release(ticket);
+      if (Trace::isEnabled()) {
+        Trace::counter("Resident bytes", Scheduler::getResidentBytes());
+      }
+      ++workerStatistics.tasks;
+      complete();
+    }
+  }
+
+  const std::function<void(std::size_t)> function;
+  std::vector<Queue> queues;
+  Admission admission;
+  // Guards the fields below.
+  std::mutex mutex;
+  std::condition_variable added;
+  // Tasks added but not taken yet. Tasks are queued before being counted, so
+  // this can be negative for a while.
+  int64_t queued = 0;
+  std::size_t running = 0;
+  bool finished = false;
+  std::size_t nextQueue = 0;
+
+  Statistics statistics;
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+};
+
+Scheduler::Pool::Pool(
+    std::size_t jobs,
+    std::function<void(std::size_t)> function,
+    uint64_t maxMemory)
+    : state(std::make_unique<State>(
+          std::max<std::size_t>(jobs, 1), std::move(function), maxMemory)) {
+  for (std::size_t i = 0; i < state->queues.size(); ++i) {
+    state->workers.emplace_back([this, i] { state->work(i); });
+  }
+}
+
+Scheduler::Pool::~Pool() {
+  if (!state->workers.empty()) {
+    finish();
+  }
+}
+
+void Scheduler::Pool::add(std::vector<Task> tasks) {
+  const auto larger = [](const Task& a, const Task& b) {
+    return a.cost > b.cost;
+  };
+  std::stable_sort(tasks.begin(), tasks.end(), larger);
+
+  // Dealing round-robin gives each queue a sorted share, which is merged into
+  // the tasks already queued, after those of the same cost.
+  std::size_t first;
+  {
+    const std::lock_guard lock(state->mutex);
+    first = state->nextQueue;
+    state->nextQueue = (first + tasks.size()) % state->queues.size();
+  }
+  std::vector<std::vector<Task>> shares(state->queues.size());
+  for (std::size_t i = 0; i < tasks.size(); ++i) {
+    shares[(first + i) % shares.size()].push_back(tasks[i]);
+  }
+  for (std::size_t i = 0; i < shares.size(); ++i) {
+    if (shares[i].empty()) {
+      continue;
+    }
+    auto& queue = state->queues[i];
+    const std::lock_guard lock(queue.mutex);
+    std::deque<Task> merged;
+    std::merge(
+        queue.tasks.begin(),
+        queue.tasks.end(),
+        shares[i].begin(),
+        shares[i].end(),
+        std::back_inserter(merged),
+        larger);
+    queue.tasks = std::move(merged);
+  }
+
+  {
+    const std::lock_guard lock(state->mutex);
+    state->queued += tasks.size();
+  }
+  state->added.notify_all();
+}
+
+Scheduler::Statistics Scheduler::Pool::finish() {
+  {
+    const std::lock_guard lock(state->mutex);
+    state->finished = true;
+  }
+  state->added.notify_all();
+  for (auto& worker : state->workers) {
+    worker.join();
+  }
+  state->workers.clear();
+
+  state->statistics.wallSeconds = std::chrono::duration<double>(
+                                      std::chrono::steady_clock::now() -
+                                      state->start)
+                                      .count();
+  return state->statistics;
+}
+
+Scheduler::Statistics Scheduler::run(
+    std::vector<Task> tasks,
+    std::size_t jobs,
+    const std::function<void(std::size_t)>& function,
+    uint64_t maxMemory) {
+  Pool pool(jobs, function, maxMemory);
+  pool.add(std::move(tasks));
+  return pool.finish();
+}
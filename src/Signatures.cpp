@@ -0,0 +1,180 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/Signatures.h"
+
+#include <bit>
+#include <stdexcept>
+
+#include <simdjson.h>
+
+namespace json = simdjson;
+
+// FNV-1a, to fingerprint the table. Each function is hashed with its kind and
+// length, so that moving a function to another container or kind changes the
+// fingerprint.
+uint64_t hashCombine(
+    uint64_t seed,
+    Signatures::Kind kind,
+    std::string_view value) {
+  const auto add = [&seed](uint8_t byte) {
+    seed = (seed ^ byte) * 0x100000001b3;
+  };
+  add(uint8_t(kind));
+  const uint64_t size = value.size();
+  for (auto i = 0; i < 8; ++i) {
+    add(uint8_t(size >> (8 * i)));
+  }
+  for (const auto c : value) {
+    add(uint8_t(c));
+  }
+  return seed;
+}
+
+Signatures::Table::Table(
+    std::vector<Container> containers,
+    std::vector<std::string> transparent)
+    : containers(std::move(containers)),
+      transparent(std::move(transparent)),
+      version(0xcbf29ce484222325) {
+  if (this->containers.size() > 64) {
+    throw std::invalid_argument("At most 64 containers are supported.");
+  }
+
+  std::size_t size = this->transparent.size();
+  for (const auto& container : this->containers) {
+    size += 1 + container.inserts.size();
+  }
+  // Keep the load factor below 1/2 so probe sequences stay short.
+  slots.resize(std::bit_ceil(2 * size + 1));
+
+  for (uint32_t i = 0; i < this->containers.size(); ++i) {
+    const auto& container = this->containers[i];
+    insert(
+        container.operatorBracket,
+        {.kind = Kind::OperatorBracket, .container = i});
+    version = hashCombine(
+        version, Kind::OperatorBracket, container.operatorBracket);
+    for (const auto& function : container.inserts) {
+      auto frame = find(function);
+      if (frame.kind != Kind::None && frame.kind != Kind::Insert) {
+        throw std::invalid_argument(
+            "Conflicting signature for " + function + ".");
+      }
+      frame.kind = Kind::Insert;
+      frame.containers |= uint64_t(1) << i;
+      insert(function, frame);
+      version = hashCombine(version, Kind::Insert, function);
+    }
+  }
+
+  for (const auto& function : this->transparent) {
+    insert(function, {.kind = Kind::Transparent});
+    version = hashCombine(version, Kind::Transparent, function);
+  }
+}
+
+void Signatures::Table::insert(std::string_view function, const Frame& frame) {
+  if (function.empty()) {
+    throw std::invalid_argument("Signatures cannot be empty.");
+  }
+
+  const auto mask = slots.size() - 1;
+  auto i = std::hash<std::string_view>()(function) & mask;
+  while (!slots[i].function.empty() && slots[i].function != function) {
+    i = (i + 1) & mask;
+  }
+  if (slots[i].function.empty() ||
+      (slots[i].frame.kind == Kind::Insert && frame.kind == Kind::Insert)) {
+    slots[i] = {function, frame};
+  } else {
+    throw std::invalid_argument(
+        "Duplicate signature " + std::string(function) + ".");
+  }
+}
+
+Signatures::Frame Signatures::Table::find(
+    std::string_view function) const noexcept {
+  const auto mask = slots.size() - 1;
+  for (auto i = std::hash<std::string_view>()(function) & mask;;
+       i = (i + 1) & mask) {
+    const auto& slot = slots[i];
+    if (slot.function.empty()) {
+      return {};
+    }
+    if (slot.function == function) {
+      return slot.frame;
+    }
+  }
+}
+
+const Signatures::Table& Signatures::Table::getDefault() {
+  static const Table table(
+      {
+          {"std::map::operator[]", {"std::_Rb_tree::_M_emplace_hint_unique"}},
+          {"std::unordered_map::operator[]",
+           {"std::_Hashtable::_Scoped_node::_Scoped_node",
+            "std::_Hashtable::_M_insert_unique_node"}},
+          {"folly::sorted_vector_map::operator[]",
+           {"folly::sorted_vector_map::insert"}},
+          {"folly::f14::detail::F14BasicMap::operator[]",
+           {"folly::f14::detail::F14Table::reserveForInsert",
+            "folly::f14::detail::F14Table::insertAtBlank"}},
+          {"facebook::multifeed::QuickHashMap::operator[]",
+           {"facebook::multifeed::detail::QuickHashTable::growSize",
+            "facebook::multifeed::detail::QuickHashTable::EntryImpl::"
+            "EntryImpl"}},
+          {"facebook::datastruct::FBHashMap::operator[]",
+           {"facebook::datastruct::FBHashMap::append_"}},
+      },
+      {"apache::thrift::field_ref::operator[]"});
+  return table;
+}
+
+Signatures::Table Signatures::Table::load(const std::string& filename) {
+  json::ondemand::parser parser;
+  json::padded_string content = json::padded_string::load(filename);
+  json::ondemand::document document = parser.iterate(content);
+
+  std::vector<Container> containers;
+  std::vector<std::string> transparent;
+  for (auto field : document.get_object()) {
+    const auto key = std::string_view(field.unescaped_key());
+    if (key == "containers") {
+      for (auto entry : field.value().get_array()) {
+        Container container;
+        container.operatorBracket =
+            std::string(std::string_view(entry["operator"]));
+        if (!container.operatorBracket.ends_with("operator[]")) {
+          throw std::invalid_argument(
+              "The operator " + container.operatorBracket + " in " + filename +
+              " does not end with operator[], so it would never be matched.");
+        }
+        for (std::string_view function : entry["inserts"]) {
+          container.inserts.emplace_back(function);
+        }
+        containers.push_back(std::move(container));
+      }
+    } else if (key == "transparent") {
+      for (std::string_view function : field.value().get_array()) {
+        transparent.emplace_back(function);
+      }
+    } else {
+      throw std::invalid_argument(
+          "Unknown key " + std::string(key) + " in " + filename + ".");
+    }
+  }
+
+  return Table(std::move(containers), std::move(transparent));
+}
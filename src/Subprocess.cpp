@@ -0,0 +1,134 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/Subprocess.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <optional>
+#include <stdexcept>
+
+extern char** environ;
+
+constexpr std::size_t kReadSize = std::size_t(64) << 10;
+
+struct Child {
+  std::size_t index;
+  pid_t pid;
+  int fd;
+  std::string output;
+};
+
+std::optional<Child> spawn(std::size_t index, const std::string& command) {
+  // Close-on-exec, so that other children do not keep the pipe open.
+  int pipes[2];
+  if (pipe2(pipes, O_CLOEXEC) != 0) {
+    return std::nullopt;
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, pipes[1], STDOUT_FILENO);
+  const char* argv[] = {"/bin/sh", "-c", command.c_str(), nullptr};
+  pid_t pid;
+  const auto error = posix_spawn(
+      &pid,
+      "/bin/sh",
+      &actions,
+      nullptr,
+      const_cast<char* const*>(argv),
+      environ);
+  posix_spawn_file_actions_destroy(&actions);
+  close(pipes[1]);
+  if (error != 0) {
+    close(pipes[0]);
+    return std::nullopt;
+  }
+  return Child{index, pid, pipes[0], {}};
+}
+
+int wait(pid_t pid) {
+  int status;
+  while (waitpid(pid, &status, 0) == -1) {
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return status;
+}
+
+void Subprocess::run(
+    const std::vector<std::string>& commands,
+    std::size_t jobs,
+    const std::function<void(std::size_t, Result)>& callback) {
+  jobs = std::max<std::size_t>(jobs, 1);
+  std::vector<Child> running;
+  std::vector<pollfd> fds;
+  std::vector<char> buffer(kReadSize);
+  std::size_t next = 0;
+  while (next < commands.size() || !running.empty()) {
+    while (running.size() < jobs && next < commands.size()) {
+      auto child = spawn(next, commands[next]);
+      if (child.has_value()) {
+        running.push_back(std::move(*child));
+      } else {
+        callback(next, {-1, ""});
+      }
+      ++next;
+    }
+    if (running.empty()) {
+      continue;
+    }
+
+    fds.clear();
+    for (const auto& child : running) {
+      fds.push_back({child.fd, POLLIN, 0});
+    }
+    if (poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error("Could not poll subprocesses.");
+    }
+
+    // Backwards, so that finished children can be erased.
+    for (auto i = running.size(); i-- > 0;) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      auto& child = running[i];
+      const auto size = read(child.fd, buffer.data(), buffer.size());
+      if (size > 0) {
+        child.output.append(buffer.data(), size);
+        continue;
+      }
+      if (size == -1 && errno == EINTR) {
+        continue;
+      }
+
+      close(child.fd);
+      const auto status = wait(child.pid);
+      const auto index = child.index;
+      auto output = std::move(child.output);
+      running.erase(running.begin() + i);
+      callback(index, {status, std::move(output)});
+    }
+  }
+}
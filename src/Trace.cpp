@@ -0,0 +1,255 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propellint/Trace.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Events are buffered per thread, and only formatted when written.
+struct Event {
+  // As in the trace-event format: 'X' for spans and 'C' for counters.
+  char phase;
+  std::string name;
+  std::string category;
+  std::string arguments;
+  int64_t timestamp;
+  int64_t duration;
+};
+
+struct Track {
+  std::mutex mutex;
+  uint64_t id;
+  std::string name;
+  std::vector<Event> events;
+};
+
+// Published with release by `start`, so that the origin is visible to the
+// threads seeing tracing enabled.
+static std::atomic<bool> enabled = false;
+static std::mutex mutex;
+static std::string path;
+// The time tracing started at, since the epoch of the clock.
+static std::atomic<std::chrono::steady_clock::rep> origin = 0;
+// Tracks outlive their threads, until they are written.
+static std::vector<std::shared_ptr<Track>> tracks;
+
+static Track& getTrack() {
+  thread_local std::shared_ptr<Track> track;
+  if (track == nullptr) {
+    track = std::make_shared<Track>();
+    const std::lock_guard lock(mutex);
+    track->id = tracks.size() + 1;
+    tracks.push_back(track);
+  }
+  return *track;
+}
+
+static int64_t getMicroseconds(std::chrono::steady_clock::time_point time) {
+  const std::chrono::steady_clock::time_point start(
+      std::chrono::steady_clock::duration(
+          origin.load(std::memory_order_relaxed)));
+  return std::chrono::duration_cast<std::chrono::microseconds>(time - start)
+      .count();
+}
+
+static void record(Event event) {
+  auto& track = getTrack();
+  const std::lock_guard lock(track.mutex);
+  track.events.push_back(std::move(event));
+}
+
+// Returns the length of the UTF-8 sequence starting `value`, or 0 if it is not
+// a valid one.
+static std::size_t getSequenceLength(std::string_view value) {
+  const auto lead = static_cast<unsigned char>(value.front());
+  std::size_t length;
+  // The range of the second byte, which excludes overlong forms, surrogates
+  // and code points above U+10FFFF.
+  unsigned char min = 0x80;
+  unsigned char max = 0xbf;
+  if (lead < 0x80) {
+    return 1;
+  } else if (lead >= 0xc2 && lead <= 0xdf) {
+    length = 2;
+  } else if (lead >= 0xe0 && lead <= 0xef) {
+    length = 3;
+    min = lead == 0xe0 ? 0xa0 : min;
+    max = lead == 0xed ? 0x9f : max;
+  } else if (lead >= 0xf0 && lead <= 0xf4) {
+    length = 4;
+    min = lead == 0xf0 ? 0x90 : min;
+    max = lead == 0xf4 ? 0x8f : max;
+  } else {
+    return 0;
+  }
+  if (value.size() < length) {
+    return 0;
+  }
+  for (std::size_t i = 1; i < length; ++i) {
+    const auto byte = static_cast<unsigned char>(value[i]);
+    if (byte < (i == 1 ? min : 0x80) || byte > (i == 1 ? max : 0xbf)) {
+      return 0;
+    }
+  }
+  return length;
+}
+
+// Bytes which are not valid UTF-8, e.g. in the paths of files, are escaped as
+// the code points of the same value, so that the trace is still valid JSON.
+static std::string escape(std::string_view value) {
+  std::string result;
+  result.reserve(value.size());
+  for (std::size_t i = 0; i < value.size();) {
+    const auto c = value[i];
+    const auto byte = static_cast<unsigned char>(c);
+    const auto length = getSequenceLength(value.substr(i));
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (byte < 0x20 || length == 0) {
+      char code[7];
+      std::snprintf(code, sizeof(code), "\\u%04x", byte);
+      result += code;
+    } else {
+      result += value.substr(i, length);
+      i += length;
+      continue;
+    }
+    ++i;
+  }
+  return result;
+}
+
+void Trace::start(const std::string& tracePath) {
+  const std::lock_guard lock(mutex);
+  path = tracePath;
+  origin.store(
+      std::chrono::steady_clock::now().time_since_epoch().count(),
+      std::memory_order_relaxed);
+  enabled.store(true, std::memory_order_release);
+}
+
+bool Trace::stop() {
+  if (!enabled.exchange(false)) {
+    return true;
+  }
+
+  const std::lock_guard lock(mutex);
+  std::ofstream out(path, std::ios::trunc);
+  const auto pid = getpid();
+  out << "{\"traceEvents\":[\n";
+  bool first = true;
+  const auto separate = [&] {
+    out << (first ? "" : ",\n");
+    first = false;
+  };
+  for (const auto& track : tracks) {
+    const std::lock_guard trackLock(track->mutex);
+    if (!track->name.empty()) {
+      separate();
+      out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid
+          << ",\"tid\":" << track->id << ",\"args\":{\"name\":\""
+          << escape(track->name) << "\"}}";
+    }
+    for (const auto& event : track->events) {
+      separate();
+      out << "{\"ph\":\"" << event.phase << "\",\"name\":\""
+          << escape(event.name) << "\",\"cat\":\"" << escape(event.category)
+          << "\",\"pid\":" << pid << ",\"tid\":" << track->id
+          << ",\"ts\":" << event.timestamp;
+      if (event.phase == 'X') {
+        out << ",\"dur\":" << event.duration;
+      }
+      out << ",\"args\":{" << event.arguments << "}}";
+    }
+    track->events.clear();
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  out.close();
+  if (!out.good()) {
+    std::cerr << "Could not write trace " << path << "." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool Trace::isEnabled() {
+  return enabled.load(std::memory_order_acquire);
+}
+
+void Trace::setThreadName(std::string_view name) {
+  if (!isEnabled()) {
+    return;
+  }
+  auto& track = getTrack();
+  const std::lock_guard lock(track.mutex);
+  track.name = name;
+}
+
+void Trace::counter(std::string_view name, int64_t value) {
+  if (!isEnabled()) {
+    return;
+  }
+  record(
+      {'C',
+       std::string(name),
+       "counter",
+       "\"" + escape(name) + "\":" + std::to_string(value),
+       getMicroseconds(std::chrono::steady_clock::now()),
+       0});
+}
+
+Trace::Span::Span(std::string_view name, std::string_view category)
+    : enabled(isEnabled()) {
+  if (enabled) {
+    this->name = name;
+    this->category = category;
+    start = std::chrono::steady_clock::now();
+  }
+}
+
+Trace::Span::~Span() {
+  if (!enabled) {
+    return;
+  }
+  const auto end = std::chrono::steady_clock::now();
+  record(
+      {'X',
+       std::move(name),
+       std::move(category),
+       std::move(arguments),
+       getMicroseconds(start),
+       getMicroseconds(end) - getMicroseconds(start)});
+}
+
+void Trace::Span::addArgument(std::string_view key, int64_t value) {
+  if (enabled) {
+    arguments += (arguments.empty() ? "\"" : ",\"") + escape(key) +
+        "\":" + std::to_string(value);
+  }
+}
+
+void Trace::Span::addArgument(std::string_view key, std::string_view value) {
+  if (enabled) {
+    arguments += (arguments.empty() ? "\"" : ",\"") + escape(key) + "\":\"" +
+        escape(value) + "\"";
+  }
+}
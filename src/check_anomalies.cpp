@@ -13,12 +13,23 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdio>
+#include <deque>
 #include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <latch>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <ostream>
+#include <set>
+#include <sstream>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -31,7 +42,6 @@
 #include <clang/AST/ASTTypeTraits.h>
 #include <clang/ASTMatchers/ASTMatchFinder.h>
 #include <clang/Frontend/ASTUnit.h>
-#include <clang/Tooling/JSONCompilationDatabase.h>
 #include <clang/Tooling/Tooling.h>
 
 #include <omp.h>
@@ -40,14 +50,27 @@
 
 #include <simdjson.h>
 
-#include <propellint/Buck.h>
+#include <propellint/Analysis.h>
+#include <propellint/Commands.h>
+#include <propellint/FileCache.h>
+#include <propellint/Formats.h>
+#include <propellint/Includes.h>
 #include <propellint/Matcher.h>
+#include <propellint/Preamble.h>
 #include <propellint/Profile.h>
+#include <propellint/ProfileCache.h>
+#include <propellint/ResultCache.h>
+#include <propellint/Scheduler.h>
+#include <propellint/Signatures.h>
+#include <propellint/Trace.h>
 
 namespace fs = std::filesystem;
 namespace json = simdjson;
 namespace po = boost::program_options;
 
+// The number of files scanned for includes by a task.
+constexpr size_t kScanChunkSize = 64;
+
 std::string toHumanReadable(uint64_t value) {
   static const std::vector<std::string> suffixes = {"", "k", "M", "G", "T"};
 
@@ -79,14 +102,57 @@ std::optional<std::pair<const char*, unsigned int>> getLocation(
   return std::make_pair(presumed.getFilename(), presumed.getLine());
 }
 
+// The sites looked for in a file.
+struct Sites {
+  std::unordered_set<Profile::CallSite> sites;
+  Matcher::LineIndex lineIndex;
+};
+
+std::shared_ptr<const Sites> makeSites(
+    std::unordered_set<Profile::CallSite> sites) {
+  auto result = std::make_shared<Sites>();
+  for (const auto& site : sites) {
+    result->lineIndex[std::string(site.first)].push_back(site.second);
+  }
+  for (auto& [_, lines] : result->lineIndex) {
+    std::sort(lines.begin(), lines.end());
+  }
+  result->sites = std::move(sites);
+  return result;
+}
+
+// A file to parse with the compile command of one of the targets.
+struct File {
+  size_t target;
+  std::string path;
+  // Shared by the files of a target, and never changed once scheduled.
+  std::shared_ptr<const Sites> sites;
+  // Precompiled first includes, if any.
+  std::string pch;
+};
+
 int main(int argc, char* argv[]) {
   po::options_description description("Options");
   // clang-format off
   description.add_options()
     ("help", "produce help message")
-    ("profile", po::value<std::string>()->required(), "path to the JSON profile")
+    ("profile", po::value<std::string>()->required(), "path to the profile")
+    ("profile-format", po::value<std::string>()->default_value("auto"), "format of the profile: auto, json, folded, perf or pprof")
     ("directory", po::value<std::string>()->required(), "path to the source directory")
-    ("jobs,j", po::value<size_t>()->default_value(1), "number of targets to process simultaneously");
+    ("profile-window", po::value<size_t>()->default_value(1024), "size in MB of the windows the profile is read in")
+    ("profile-cache", po::value<std::string>(), "path to a binary cache of the parsed profile, written if missing or stale")
+    ("normalize-frames", "normalize raw demangled frames (template arguments, parameters, clone suffixes) before matching signatures")
+    ("signatures", po::value<std::string>(), "path to a JSON file of container signatures, replacing the built-in ones")
+    ("engine", po::value<std::string>()->default_value("matcher"), "how operator[] calls are found: matcher or visitor")
+    ("pch-directory", po::value<std::string>(), "path to a directory where the first includes shared by files with the same compile command are precompiled")
+    ("result-cache", po::value<std::string>(), "path to a directory caching what was matched in each file, reused while the file, its includes and its compile command are unchanged")
+    ("jobs,j", po::value<size_t>()->default_value(1), "number of threads used to parse the profile and process files")
+    ("compile-commands", po::value<std::string>(), "path to a compile_commands.json, e.g. written by CMake, Bazel or Bear, used instead of Buck")
+    ("buck-jobs", po::value<size_t>()->default_value(4), "number of buck commands building compilation databases at a time")
+    ("deny-list", po::value<std::string>(), "path to a list of targets whose compilation database cannot be built, skipped and extended by each run, and built again after a week")
+    ("buck-cache", po::value<std::string>(), "path to an index of the owners and compilation databases found by previous runs, reused until build files or the Buck configuration change")
+    ("max-memory", po::value<size_t>()->default_value(0), "memory in MB above which no new file is parsed until others finish, 0 for no limit")
+    ("trace", po::value<std::string>(), "path to a Chrome trace of the phases and files, opened by chrome://tracing or Perfetto");
   // clang-format on
 
   po::variables_map vm;
@@ -98,127 +164,720 @@ int main(int argc, char* argv[]) {
   }
   po::notify(vm);
 
+  if (vm.count("trace")) {
+    Trace::start(vm.at("trace").as<std::string>());
+    Trace::setThreadName("Main");
+  }
+
   const auto profile = vm.at("profile").as<std::string>();
   const auto directory = vm.at("directory").as<std::string>();
   const auto jobs = vm.at("jobs").as<size_t>();
+  const auto maxMemory = vm.at("max-memory").as<size_t>() << 20;
+  const auto engineName = vm.at("engine").as<std::string>();
+  const auto engine = Analysis::parseEngine(engineName);
+  const auto normalizeFrames = vm.count("normalize-frames") != 0;
+
+  std::optional<Signatures::Table> customSignatures;
+  if (vm.count("signatures")) {
+    customSignatures.emplace(
+        Signatures::Table::load(vm.at("signatures").as<std::string>()));
+  }
+  const auto& signatures = customSignatures.has_value()
+      ? customSignatures.value()
+      : Signatures::Table::getDefault();
+
+  std::optional<ProfileCache::Source> source;
+  std::optional<ProfileCache::Content> cached;
+  if (vm.count("profile-cache")) {
+    Trace::Span span("Check profile cache");
+    std::cout << "Checking profile cache..." << std::endl;
+    source = ProfileCache::getSource(profile, jobs);
+    source->normalizedFrames = normalizeFrames;
+    cached = ProfileCache::load(
+        vm.at("profile-cache").as<std::string>(), source.value(), signatures);
+  }
 
-  std::cout << "Loading JSON file..." << std::endl;
-  json::padded_string json = json::padded_string::load(profile);
+  Profile::Locations operatorBracketLocations;
+  if (cached.has_value()) {
+    operatorBracketLocations = std::move(cached->locations);
+    std::cout << "Successfully loaded profile cache." << std::endl;
+  } else {
+    const auto& formatName = vm.at("profile-format").as<std::string>();
+    const auto format = formatName == "auto" ? Formats::detect(profile)
+                                             : Formats::parse(formatName);
+    std::cout << "Parsing profile..." << std::endl;
+    Trace::Span span("Parse profile");
+    span.addArgument("format", formatName);
+    // The profile is streamed, and only the strings we keep are copied, so
+    // the profile itself does not stay in memory.
+    Profile::IngestionStatistics statistics;
+    auto stacks = Formats::getFoldedStacks(
+        profile,
+        format,
+        signatures,
+        jobs,
+        vm.at("profile-window").as<size_t>() << 20,
+        statistics,
+        normalizeFrames);
+    if (normalizeFrames) {
+      stacks = Profile::normalizeFrames(stacks);
+    }
+    operatorBracketLocations =
+        Profile::getOperatorBracketLocations(stacks, signatures);
+    span.addArgument("bytes", statistics.scannedBytes);
+    span.addArgument("records", statistics.records);
+    span.addArgument("skipped", statistics.skippedRecords);
+    span.addArgument("stacks", statistics.uniqueStacks);
+    std::cout << "Skipped " << statistics.skippedRecords << "/"
+              << statistics.records << " records without operator[] (scanned "
+              << toHumanReadable(statistics.scannedBytes) << "B at "
+              << toHumanReadable(uint64_t(
+                     statistics.scannedBytes /
+                     std::max(statistics.scanSeconds, 1e-9)))
+              << "B/s per thread), " << statistics.uniqueStacks
+              << " unique stacks." << std::endl;
+
+    if (source.has_value()) {
+      ProfileCache::save(
+          vm.at("profile-cache").as<std::string>(),
+          source.value(),
+          signatures,
+          operatorBracketLocations,
+          nullptr);
+    }
+  }
 
-  std::cout << "Parsing JSON file..." << std::endl;
-  // We need the parser to have "global" scope so the string views stay valid.
-  json::ondemand::parser parser;
   const auto insertOperatorBracketLocations =
-      Profile::getInsertOperatorBracketLocations(parser, json);
-  std::cout << "Successfully parsed JSON file ("
+      Profile::getInsertOperatorBracketLocations(operatorBracketLocations);
+  std::cout << "Successfully parsed profile ("
             << insertOperatorBracketLocations.size()
             << " total operator[] locations)." << std::endl;
 
   std::cout << "Finding compilation targets..." << std::endl;
 
+  const auto callSites = insertOperatorBracketLocations.getCallSites();
   std::unordered_set<std::string> filenames;
-  for (const auto& [site, _] : insertOperatorBracketLocations) {
+  for (const auto& site : callSites) {
     const auto filename = std::string(site.first);
     if (fs::exists(directory + "/" + filename)) {
       filenames.emplace(std::move(filename));
     }
   }
 
-  const auto filenameToTargetMap =
-      Buck::getFilenameToTargetMap(directory, filenames);
+  std::unique_ptr<Commands::Provider> provider;
+  if (vm.count("compile-commands")) {
+    provider = std::make_unique<Commands::JsonProvider>(
+        directory, vm.at("compile-commands").as<std::string>());
+  } else {
+    Commands::BuckOptions options;
+    options.jobs = vm.at("buck-jobs").as<size_t>();
+    if (vm.count("deny-list")) {
+      options.denyListPath = vm.at("deny-list").as<std::string>();
+    }
+    if (vm.count("buck-cache")) {
+      options.cachePath = vm.at("buck-cache").as<std::string>();
+    }
+    provider = std::make_unique<Commands::BuckProvider>(directory, options);
+  }
+  const auto filenameToTargetMap = [&] {
+    Trace::Span span("Find owners");
+    span.addArgument("files", filenames.size());
+    return provider->getOwners(filenames);
+  }();
+
+  // A file owned by several targets is only built once, with the target owning
+  // the most profiled files, so that fewer compilation databases are needed.
+  std::unordered_map<std::string, size_t> targetToFileCountMap;
+  for (const auto& [_, targets] : filenameToTargetMap) {
+    for (const auto& target : targets) {
+      ++targetToFileCountMap[target];
+    }
+  }
+  std::unordered_map<std::string, std::unordered_set<std::string>>
+      targetToFilenamesMap;
+  for (const auto& [filename, targets] : filenameToTargetMap) {
+    // This can happen if no target was found for the given filename.
+    if (targets.empty()) {
+      continue;
+    }
+    const auto& target = *std::max_element(
+        targets.begin(),
+        targets.end(),
+        [&targetToFileCountMap](const auto& left, const auto& right) {
+          const auto leftCount = targetToFileCountMap.at(left);
+          const auto rightCount = targetToFileCountMap.at(right);
+          return leftCount < rightCount ||
+              (leftCount == rightCount && left > right);
+        });
+    targetToFilenamesMap[target].insert(filename);
+  }
+
+  // Headers are not compiled by themselves. Each profiled header is analyzed
+  // once, through the cheapest file including it.
+  std::unordered_set<std::string> headers;
+  for (const auto& filename : filenames) {
+    if (Includes::isHeader(filename)) {
+      headers.insert(filename);
+    }
+  }
+  for (auto& [_, targetFilenames] : targetToFilenamesMap) {
+    std::erase_if(targetFilenames, [&headers](const auto& filename) {
+      return headers.contains(filename);
+    });
+  }
+
   std::unordered_map<std::string, std::unordered_set<Profile::CallSite>>
       targetToCallSitesMap;
-  for (const auto& [site, _] : insertOperatorBracketLocations) {
-    const auto it = filenameToTargetMap.find(std::string(site.first));
-    // This can happen if no target was found for the given filename.
-    if (it != filenameToTargetMap.end()) {
-      for (const auto& target : it->second) {
-        targetToCallSitesMap[target].insert(site);
+  for (const auto& [target, targetFilenames] : targetToFilenamesMap) {
+    auto& sites = targetToCallSitesMap[target];
+    for (const auto& site : callSites) {
+      if (targetFilenames.contains(std::string(site.first))) {
+        sites.insert(site);
       }
     }
   }
   std::cout << "Successfully found " << targetToCallSitesMap.size()
-            << " targets." << std::endl;
+            << " targets for " << filenameToTargetMap.size() << " files."
+            << std::endl;
 
-  std::cout << "Building compilation database files..." << std::endl;
-  auto targets = targetToCallSitesMap | ranges::views::keys |
+  const auto targets = targetToCallSitesMap | ranges::views::keys |
       ranges::to<std::vector<std::string>>();
-  const auto targetToDatabaseMap =
-      Buck::buildCompilationDatabases2(directory, targets);
-  std::cout << "Successfully built " << targetToDatabaseMap.size() << "/"
-            << targetToCallSitesMap.size() << " compilation datases."
-            << std::endl;
+  std::unordered_map<std::string, size_t> targetIndexes;
+  for (size_t i = 0; i < targets.size(); ++i) {
+    targetIndexes.emplace(targets[i], i);
+  }
+  std::vector<std::unique_ptr<clang::tooling::CompilationDatabase>> databases(
+      targets.size());
+
+  // Headers are read by many tools, from many threads.
+  FileCache::Cache fileCache;
+  std::optional<Includes::Index> includes;
+  if (!headers.empty()) {
+    includes.emplace(directory, headers);
+  }
 
-  // Filter out targets for which we couldn't get a compilation database.
-  std::erase_if(targets, [&targetToDatabaseMap](const auto& entry) {
-    return !targetToDatabaseMap.contains(entry);
-  });
+  const auto usePchs = vm.count("pch-directory") != 0;
+  std::atomic<size_t> pchFallbacks = 0;
 
-  const auto matcher = Matcher::get();
+  std::optional<ResultCache::Cache> resultCache;
+  if (vm.count("result-cache")) {
+    resultCache.emplace(vm.at("result-cache").as<std::string>());
+  }
+  std::atomic<size_t> cachedFiles = 0;
+
+  Analysis::Statistics analysisStatistics;
+  // Sites are reported once, even if a file is parsed for its own sites and
+  // again for the headers it includes.
+  std::mutex reportMutex;
+  std::unordered_set<Profile::CallSite> reportedSites;
+  const auto report = [&](const Profile::CallSite& site) {
+    {
+      const std::lock_guard lock(reportMutex);
+      if (!reportedSites.insert(site).second) {
+        return;
+      }
+    }
 
-  omp_set_num_threads(jobs);
-#pragma omp parallel for
-  for (auto i = 0; i < targets.size(); ++i) {
-    const auto& target = targets.at(i);
-    const auto& sites = targetToCallSitesMap.at(target);
-    const auto& database_path = targetToDatabaseMap.at(target);
+    const auto& weights = insertOperatorBracketLocations.at(site);
+    std::cout << toHumanReadable(weights.first) << "/"
+              << toHumanReadable(weights.second) << " " << site.first << ":"
+              << site.second << std::endl;
+  };
+
+  const auto parse = [&](const File& file) {
+    const auto& path = file.path;
+    const auto& target = targets.at(file.target);
+    const auto& sites = file.sites->sites;
+    const auto& lineIndex = file.sites->lineIndex;
+    Trace::Span span("Process file", "file");
+    span.addArgument("path", path);
+    span.addArgument("target", target);
+
+    // Only one compile command is used per file.
+    const Analysis::FirstCommandDatabase firstCommandDatabase(
+        *databases[file.target]);
+
+    // Results are reused if all the lines needed now were checked.
+    std::optional<uint64_t> key;
+    std::optional<ResultCache::Entry> entry;
+    std::string workingDirectory;
+    // Only the sites of the file and of the files it includes can be matched
+    // in it, so the sites of the other files of the target are neither needed
+    // from its entry nor recorded in it.
+    const auto isOwnSite = [&](const std::unordered_set<std::string>& files,
+                               const std::string& filename) {
+      return files.contains(
+          (fs::path(workingDirectory) / filename).lexically_normal().string());
+    };
+    if (resultCache.has_value()) {
+      const auto commands = firstCommandDatabase.getCompileCommands(path);
+      if (!commands.empty()) {
+        workingDirectory = commands.front().Directory;
+        key = resultCache->getKey(
+            path, workingDirectory, commands.front().CommandLine, engineName);
+      }
+      if (key.has_value()) {
+        entry = resultCache->load(*key);
+      }
+    }
+    if (entry.has_value()) {
+      std::unordered_set<std::string> files = {
+          fs::path(path).lexically_normal().string()};
+      for (const auto& [filename, _] : entry->dependencies) {
+        files.insert(filename);
+      }
+      std::set<std::pair<std::string_view, unsigned>> checked;
+      for (const auto& line : entry->lines) {
+        checked.emplace(line.filename, line.line);
+      }
+      const auto covered =
+          std::all_of(lineIndex.begin(), lineIndex.end(), [&](auto& file) {
+            if (!isOwnSite(files, file.first)) {
+              return true;
+            }
+            return std::all_of(
+                file.second.begin(), file.second.end(), [&](auto line) {
+                  return checked.contains({file.first, line});
+                });
+          });
+      if (covered) {
+        for (const auto& line : entry->lines) {
+          const auto site = sites.find(
+              std::make_pair(std::string_view(line.filename), int(line.line)));
+          if (line.matched && site != sites.end()) {
+            report(*site);
+          }
+        }
+        span.addArgument("cached", 1);
+        ++cachedFiles;
+        return;
+      }
+    }
 
-    std::unordered_set<std::string> filenames;
-    for (const auto& site : sites) {
-      filenames.insert(directory + "/" + std::string(site.first));
+    const auto pchContainerOperations =
+        std::make_shared<clang::PCHContainerOperations>();
+    clang::tooling::ClangTool tool(
+        firstCommandDatabase,
+        {path},
+        pchContainerOperations,
+        FileCache::newFileSystem(fileCache));
+    if (!file.pch.empty()) {
+      tool.appendArgumentsAdjuster(clang::tooling::getInsertArgumentAdjuster(
+          {"-include-pch", file.pch},
+          clang::tooling::ArgumentInsertPosition::BEGIN));
+    }
+    std::set<std::pair<std::string_view, unsigned>> matched;
+    std::vector<std::string> dependencies;
+    // Each file is parsed with the bodies away from its sites skipped, and
+    // matched before its AST is freed. Only the functions covering a profiled
+    // line are matched, the sites are still checked since a function covers
+    // many lines.
+    const auto factory = Analysis::newSiteActionFactory(
+        lineIndex,
+        engine,
+        [&](const clang::CXXOperatorCallExpr& bracket,
+            clang::ASTContext& context) {
+          const auto location =
+              getLocation(bracket.getExprLoc(), context.getSourceManager());
+          if (!location.has_value()) {
+            return;
+          }
+
+          const auto& [filename, line] = location.value();
+          const auto site =
+              sites.find(std::make_pair(std::string_view(filename), int(line)));
+          if (site == sites.end()) {
+            return;
+          }
+          matched.emplace(site->first, site->second);
+          report(*site);
+        },
+        analysisStatistics,
+        key.has_value() ? &dependencies : nullptr);
+    int status = tool.run(factory.get());
+    if (status == 1 && !file.pch.empty()) {
+      // The precompiled header may not fit the file, e.g. if it relies on
+      // being included first.
+      ++pchFallbacks;
+      matched.clear();
+      dependencies.clear();
+      clang::tooling::ClangTool fallbackTool(
+          firstCommandDatabase,
+          {path},
+          pchContainerOperations,
+          FileCache::newFileSystem(fileCache));
+      status = fallbackTool.run(factory.get());
+    }
+    assert(status == 0 || status == 1 || status == 2);
+    span.addArgument("status", status);
+    span.addArgument("sites", sites.size());
+    span.addArgument("matched", matched.size());
+    if (status == 1) {
+      std::cerr << "Failed to parse " << path << " in " << target << "."
+                << std::endl;
+    } else if (status == 2) {
+      std::cerr << "Could not find compile commands for " << path << " in "
+                << target << "." << std::endl;
     }
 
+    if (status == 0 && key.has_value()) {
+      // Lines checked by previous runs are kept, since the file and its
+      // includes did not change.
+      std::unordered_set<std::string> files = {
+          fs::path(path).lexically_normal().string()};
+      for (const auto& dependency : dependencies) {
+        files.insert((fs::path(workingDirectory) / dependency)
+                         .lexically_normal()
+                         .string());
+      }
+      std::vector<ResultCache::Line> lines;
+      for (const auto& [filename, fileLines] : lineIndex) {
+        if (!isOwnSite(files, filename)) {
+          continue;
+        }
+        for (const auto line : fileLines) {
+          lines.push_back({filename, line, matched.contains({filename, line})});
+        }
+      }
+      if (entry.has_value()) {
+        for (auto& line : entry->lines) {
+          const auto file = lineIndex.find(line.filename);
+          if (file == lineIndex.end() ||
+              !std::binary_search(
+                  file->second.begin(), file->second.end(), line.line)) {
+            lines.push_back(std::move(line));
+          }
+        }
+      }
+      resultCache->save(*key, workingDirectory, dependencies, lines);
+    }
+  };
+
+  // Work is scheduled as soon as it is known: each compilation database is
+  // loaded once built, and its files parsed once loaded, while Buck builds
+  // the others. Files are scheduled individually, largest first, since the
+  // cost of the targets varies by orders of magnitude.
+  std::mutex workMutex;
+  std::deque<std::function<void()>> work;
+  std::atomic<size_t> fileCount = 0;
+  // With precompiled includes, files are only parsed once they are all known,
+  // so that they can be grouped.
+  std::mutex pendingFilesMutex;
+  std::vector<File> pendingFiles;
+  // Includes are scanned in all the targets before headers are assigned. A
+  // target is counted down once all its files are scanned.
+  std::latch loaded(targets.size());
+  Scheduler::Pool pool(
+      jobs,
+      [&](size_t id) {
+        std::function<void()> function;
+        {
+          const std::lock_guard lock(workMutex);
+          function = std::move(work[id]);
+        }
+        function();
+      },
+      maxMemory);
+  const auto schedule =
+      [&](std::vector<std::pair<std::function<void()>, uint64_t>> functions) {
+        std::vector<Scheduler::Task> tasks;
+        {
+          const std::lock_guard lock(workMutex);
+          for (auto& [function, cost] : functions) {
+            tasks.push_back({work.size(), cost});
+            work.push_back(std::move(function));
+          }
+        }
+        pool.add(std::move(tasks));
+      };
+  const auto scheduleFiles = [&](std::vector<File> files) {
+    std::vector<std::pair<std::function<void()>, uint64_t>> functions;
+    for (auto& file : files) {
+      std::error_code error;
+      const auto size = fs::file_size(file.path, error);
+      functions.emplace_back(
+          [&parse, file = std::move(file)] { parse(file); }, error ? 0 : size);
+    }
+    schedule(std::move(functions));
+  };
+  const auto addFiles = [&](std::vector<File> files) {
+    fileCount += files.size();
+    if (usePchs) {
+      const std::lock_guard lock(pendingFilesMutex);
+      std::move(files.begin(), files.end(), std::back_inserter(pendingFiles));
+    } else {
+      scheduleFiles(std::move(files));
+    }
+  };
+
+  const auto load = [&](size_t i, const Commands::Loader& loader) {
+    const auto& target = targets[i];
+    Trace::Span span("Load database", "target");
+    span.addArgument("target", target);
     std::string error;
-    const auto database = clang::tooling::JSONCompilationDatabase::loadFromFile(
-        database_path,
-        error,
-        clang::tooling::JSONCommandLineSyntax::AutoDetect);
-    if (!database) {
+    databases[i] = loader(error);
+    if (!databases[i]) {
       std::cerr << "Could not load compilation database for " << target << "."
                 << std::endl
                 << error << std::endl;
-      continue;
+      loaded.count_down();
+      return;
     }
 
-    clang::tooling::ClangTool tool(
-        *database,
-        std::vector<std::string>(filenames.begin(), filenames.end()));
-    std::vector<std::unique_ptr<clang::ASTUnit>> ASTs;
-    int status = tool.buildASTs(ASTs);
-    assert(status == 0 || status == 1 || status == 2);
-    if (status == 1) {
-      std::cerr << "Failed to build ASTs for " << target << "." << std::endl;
-      continue;
-    } else if (status == 2) {
-      std::cerr << "Failed to build an AST for some files in " << target << "."
-                << std::endl;
+    const auto sites = makeSites(targetToCallSitesMap.at(target));
+    std::vector<File> files;
+    for (const auto& filename : targetToFilenamesMap.at(target)) {
+      files.push_back({i, directory + "/" + filename, sites, ""});
     }
+    addFiles(std::move(files));
 
-    for (size_t i = 0; i < ASTs.size(); ++i) {
-      const auto matches =
-          clang::ast_matchers::match(matcher, ASTs[i]->getASTContext());
+    if (!includes.has_value()) {
+      loaded.count_down();
+      return;
+    }
 
-      for (const auto& match : matches) {
-        const auto* bracket =
-            match.getNodeAs<clang::CXXOperatorCallExpr>("bracket");
-        const auto location =
-            getLocation(bracket->getExprLoc(), ASTs[i]->getSourceManager());
-        if (!location.has_value()) {
-          continue;
-        }
+    // Files are scanned in chunks, so that a large database, such as the
+    // single one of a compile_commands.json, is spread over the workers.
+    const auto allFiles =
+        Analysis::FirstCommandDatabase(*databases[i]).getAllFiles();
+    if (allFiles.empty()) {
+      loaded.count_down();
+      return;
+    }
+    const auto remaining = std::make_shared<std::atomic<size_t>>(
+        (allFiles.size() + kScanChunkSize - 1) / kScanChunkSize);
+    std::vector<std::pair<std::function<void()>, uint64_t>> functions;
+    for (size_t first = 0; first < allFiles.size(); first += kScanChunkSize) {
+      const auto last = std::min(first + kScanChunkSize, allFiles.size());
+      std::vector<std::string> chunk(
+          allFiles.begin() + first, allFiles.begin() + last);
+      uint64_t cost = 0;
+      for (const auto& file : chunk) {
+        std::error_code error;
+        const auto size = fs::file_size(file, error);
+        cost += error ? 0 : size;
+      }
+      functions.emplace_back(
+          [&, i, remaining, chunk = std::move(chunk)] {
+            Trace::Span span("Scan files", "target");
+            span.addArgument("target", targets[i]);
+            span.addArgument("files", chunk.size());
+            const Analysis::FirstCommandDatabase database(*databases[i]);
+            includes->scan(
+                targets[i],
+                database,
+                chunk,
+                FileCache::newFileSystem(fileCache));
+            if (--*remaining == 0) {
+              loaded.count_down();
+            }
+          },
+          cost);
+    }
+    schedule(std::move(functions));
+  };
 
-        const auto& [filename, line] = location.value();
-        const auto site = std::make_pair(std::string_view(filename), line);
-        if (!sites.contains(site)) {
-          continue;
+  std::cout << "Building compilation database files..." << std::endl;
+  std::optional<Trace::Span> phase(std::in_place, "Build databases");
+  std::vector<bool> built(targets.size());
+  size_t builtCount = 0;
+  const auto missingTargets = provider->getDatabases(
+      targets,
+      [&](const std::string& target, Commands::Loader loader, uint64_t cost) {
+        const auto it = targetIndexes.find(target);
+        if (it == targetIndexes.end() || built[it->second]) {
+          return;
         }
+        const auto i = it->second;
+        built[i] = true;
+        ++builtCount;
+        schedule({{[&load, i, loader = std::move(loader)] { load(i, loader); },
+                   cost}});
+      });
+  for (const auto& target : missingTargets) {
+    std::cerr << "Could not build database for " << target << "." << std::endl;
+  }
+  for (size_t i = 0; i < targets.size(); ++i) {
+    if (!built[i]) {
+      loaded.count_down();
+    }
+  }
+  phase->addArgument("targets", targets.size());
+  phase->addArgument("built", builtCount);
+  phase.reset();
+  std::cout << "Successfully built " << builtCount << "/" << targets.size()
+            << " compilation databases." << std::endl;
+
+  if (includes.has_value()) {
+    std::cout << "Scanning includes for " << headers.size() << " headers..."
+              << std::endl;
+    Trace::Span span("Scan includes");
+    span.addArgument("headers", headers.size());
+    loaded.wait();
+
+    // Each header is matched in its includer only, with the sites of the
+    // headers it was chosen for. Includers are parsed again for these sites,
+    // even if they were parsed for their own sites.
+    std::map<
+        std::pair<std::string, std::string>,
+        std::unordered_set<Profile::CallSite>>
+        includerToHeaderSitesMap;
+    for (const auto& site : callSites) {
+      const auto includer = includes->find(std::string(site.first));
+      if (includer.has_value()) {
+        includerToHeaderSitesMap[{includer->target, includer->filename}]
+            .insert(site);
+      }
+    }
+    std::vector<File> files;
+    for (auto& [includer, sites] : includerToHeaderSitesMap) {
+      const auto& [target, filename] = includer;
+      files.push_back(
+          {targetIndexes.at(target),
+           directory + "/" + filename,
+           makeSites(std::move(sites)),
+           ""});
+    }
+    addFiles(std::move(files));
+    std::cout << "Successfully found includers for " << includes->size() << "/"
+              << headers.size() << " headers." << std::endl;
+  }
 
-        const auto insertWeight = insertOperatorBracketLocations.at(site).first;
-        const auto totalWeight = insertOperatorBracketLocations.at(site).second;
-        std::cout << toHumanReadable(insertWeight) << "/"
-                  << toHumanReadable(totalWeight) << " " << site.first << ":"
-                  << site.second << std::endl;
+  // Files sharing a compile command and their first includes are parsed with
+  // these includes precompiled once.
+  if (usePchs) {
+    Trace::Span span("Precompile includes");
+    loaded.wait();
+    const auto pchDirectory = vm.at("pch-directory").as<std::string>();
+    fs::create_directories(pchDirectory);
+    auto& files = pendingFiles;
+
+    std::vector<std::optional<clang::tooling::CompileCommand>> commands(
+        files.size());
+    std::vector<std::vector<std::string>> fileIncludes(files.size());
+    omp_set_num_threads(jobs);
+#pragma omp parallel for
+    for (size_t id = 0; id < files.size(); ++id) {
+      const auto& path = files[id].path;
+      auto fileCommands =
+          Analysis::FirstCommandDatabase(*databases[files[id].target])
+              .getCompileCommands(path);
+      if (fileCommands.empty()) {
+        continue;
+      }
+      commands[id] = std::move(fileCommands.front());
+      std::ifstream in(path);
+      std::stringstream code;
+      code << in.rdbuf();
+      fileIncludes[id] = Preamble::getIncludes(code.str());
+    }
+
+    std::unordered_map<std::string, std::vector<size_t>> groups;
+    for (size_t id = 0; id < files.size(); ++id) {
+      if (commands[id].has_value() && !fileIncludes[id].empty()) {
+        groups[Preamble::getGroupKey(*commands[id])].push_back(id);
+      }
+    }
+    // A precompiled header only pays off when it is used more than once.
+    std::vector<std::vector<size_t>> pchGroups;
+    std::vector<Scheduler::Task> pchTasks;
+    for (auto& [_, ids] : groups) {
+      if (ids.size() > 1) {
+        pchTasks.push_back({pchGroups.size(), ids.size()});
+        pchGroups.push_back(std::move(ids));
       }
     }
+
+    std::atomic<size_t> builtPchs = 0;
+    Scheduler::run(
+        std::move(pchTasks),
+        jobs,
+        [&](size_t group) {
+          const auto& ids = pchGroups[group];
+          Trace::Span span("Precompile", "file");
+          span.addArgument("files", ids.size());
+          std::vector<std::vector<std::string>> groupIncludes;
+          for (const auto id : ids) {
+            groupIncludes.push_back(fileIncludes[id]);
+          }
+          const auto prefix = Preamble::getCommonPrefix(groupIncludes);
+          if (prefix.empty()) {
+            return;
+          }
+
+          // Named after the command and the directives rather than the order
+          // of the groups, so that runs sharing the directory do not replace
+          // each other's headers with different ones.
+          const auto& command = *commands[ids.front()];
+          char name[21];
+          std::snprintf(
+              name,
+              sizeof(name),
+              "%016llx.pch",
+              (unsigned long long)Preamble::hash(
+                  Preamble::getGroupKey(command), prefix));
+          const auto pch = pchDirectory + "/" + name;
+          if (!Preamble::build(
+                  command,
+                  prefix,
+                  pch,
+                  FileCache::newFileSystem(fileCache))) {
+            std::cerr << "Could not precompile the includes of "
+                      << files[ids.front()].path << "." << std::endl;
+            return;
+          }
+          for (const auto id : ids) {
+            files[id].pch = pch;
+          }
+          ++builtPchs;
+        },
+        maxMemory);
+    std::cout << "Precompiled the common includes of " << builtPchs << "/"
+              << pchGroups.size() << " groups of files." << std::endl;
+
+    scheduleFiles(std::move(files));
+  }
+
+  phase.emplace("Process files");
+  const auto schedulerStatistics = pool.finish();
+  phase->addArgument("files", fileCount.load());
+  phase.reset();
+
+  const auto& fileCacheStatistics = fileCache.getStatistics();
+  std::cout << "Served " << fileCacheStatistics.hits << "/"
+            << fileCacheStatistics.hits + fileCacheStatistics.misses
+            << " file system lookups from the cache." << std::endl;
+  if (vm.count("pch-directory")) {
+    std::cout << "Parsed " << pchFallbacks
+              << " files again without their precompiled includes."
+              << std::endl;
+  }
+  if (resultCache.has_value()) {
+    std::cout << "Reused cached results for " << cachedFiles << "/"
+              << fileCount << " files." << std::endl;
+  }
+  for (size_t i = 0; i < schedulerStatistics.workers.size(); ++i) {
+    const auto& worker = schedulerStatistics.workers[i];
+    const auto utilization = schedulerStatistics.wallSeconds > 0
+        ? worker.busySeconds / schedulerStatistics.wallSeconds
+        : 0;
+    std::cout << "Worker " << i << " processed " << worker.tasks
+              << " tasks (" << worker.stolenTasks << " stolen), busy "
+              << int(utilization * 100) << "% of "
+              << schedulerStatistics.wallSeconds << "s, waited "
+              << worker.waitingSeconds << "s for memory." << std::endl;
+  }
+  std::cout << "Skipped " << analysisStatistics.skippedBodies << "/"
+            << analysisStatistics.bodies << " function bodies, matched in "
+            << analysisStatistics.matchNanoseconds / 1e9 << "s with the "
+            << engineName << " engine." << std::endl;
+
+  const auto peakResidentBytes = Scheduler::getPeakResidentBytes();
+  Trace::counter("Peak resident bytes", peakResidentBytes);
+  std::cout << "Peak resident memory: "
+            << toHumanReadable(peakResidentBytes) << "B." << std::endl;
+  if (vm.count("trace") && Trace::stop()) {
+    std::cout << "Wrote trace to " << vm.at("trace").as<std::string>() << "."
+              << std::endl;
   }
 }
@@ -0,0 +1,139 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <clang/Tooling/JSONCompilationDatabase.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <gtest/gtest.h>
+
+#include <propellint/Analysis.h>
+
+static const std::string kCode = R"(
+  namespace std {
+  template<class Key, class T>
+  struct map {
+    T& operator[](const Key&);
+  };
+  } // namespace std
+
+  int hot(std::map<int, int>& map) {
+    return map[0];
+  }
+
+  // Does not compile, unless its body is skipped.
+  int cold(std::map<int, int>& map) {
+    return map[1] + undeclared;
+  }
+)";
+
+unsigned getLine(const std::string& code, const std::string& needle) {
+  const auto offset = code.find(needle);
+  return std::count(code.begin(), code.begin() + offset, '\n') + 1;
+}
+
+std::vector<unsigned> runSiteAction(
+    const Matcher::LineIndex& index,
+    Analysis::Engine engine,
+    Analysis::Statistics& statistics) {
+  std::vector<unsigned> lines;
+  const auto success = clang::tooling::runToolOnCode(
+      std::make_unique<Analysis::SiteAction>(
+          index,
+          engine,
+          [&lines](
+              const clang::CXXOperatorCallExpr& bracket,
+              clang::ASTContext& context) {
+            lines.push_back(context.getSourceManager().getPresumedLineNumber(
+                bracket.getExprLoc()));
+          },
+          statistics),
+      kCode,
+      "input.cc");
+  EXPECT_TRUE(success);
+  return lines;
+}
+
+TEST(Analysis, testSkipsBodiesWithoutSites) {
+  const auto line = getLine(kCode, "map[0]");
+  for (const auto engine :
+       {Analysis::Engine::Matcher, Analysis::Engine::Visitor}) {
+    Analysis::Statistics statistics;
+    EXPECT_EQ(
+        runSiteAction({{"input.cc", {line}}}, engine, statistics),
+        std::vector{line});
+    EXPECT_EQ(statistics.bodies, 2);
+    EXPECT_EQ(statistics.skippedBodies, 1);
+  }
+}
+
+TEST(Analysis, testSkipsFilesWithoutSites) {
+  const auto line = getLine(kCode, "map[0]");
+  Analysis::Statistics statistics;
+  const auto lines = runSiteAction(
+      {{"other.cc", {line}}}, Analysis::Engine::Visitor, statistics);
+  EXPECT_TRUE(lines.empty());
+  EXPECT_EQ(statistics.skippedBodies, 2);
+}
+
+TEST(Analysis, testParseEngine) {
+  EXPECT_EQ(Analysis::parseEngine("visitor"), Analysis::Engine::Visitor);
+  EXPECT_THROW(Analysis::parseEngine("other"), std::invalid_argument);
+}
+
+TEST(Analysis, testFirstCommandDatabase) {
+  std::string error;
+  const auto database = clang::tooling::JSONCompilationDatabase::loadFromBuffer(
+      R"([
+        {"directory": "/d", "file": "a.cpp", "arguments": ["cc", "-DA", "a"]},
+        {"directory": "/d", "file": "a.cpp", "arguments": ["cc", "-DB", "a"]},
+        {"directory": "/d", "file": "b.cpp", "arguments": ["cc", "b.cpp"]}
+      ])",
+      error,
+      clang::tooling::JSONCommandLineSyntax::AutoDetect);
+  ASSERT_NE(database, nullptr) << error;
+
+  const Analysis::FirstCommandDatabase first(*database);
+  const auto commands = first.getCompileCommands("/d/a.cpp");
+  ASSERT_EQ(commands.size(), 1);
+  EXPECT_EQ(commands[0].CommandLine[1], "-DA");
+  EXPECT_EQ(first.getAllCompileCommands().size(), 2);
+}
+
+TEST(Analysis, testCollectsDependencies) {
+  Analysis::Statistics statistics;
+  std::vector<std::string> dependencies;
+  const auto success = clang::tooling::runToolOnCodeWithArgs(
+      std::make_unique<Analysis::SiteAction>(
+          Matcher::LineIndex(),
+          Analysis::Engine::Visitor,
+          [](const clang::CXXOperatorCallExpr&, clang::ASTContext&) {},
+          statistics,
+          &dependencies),
+      "#include \"a.h\"\n",
+      {},
+      "input.cc",
+      "clang-tool",
+      std::make_shared<clang::PCHContainerOperations>(),
+      {{"a.h", "int a();\n"}});
+  ASSERT_TRUE(success);
+
+  EXPECT_TRUE(std::any_of(
+      dependencies.begin(), dependencies.end(), [](const auto& dependency) {
+        return dependency.ends_with("a.h");
+      }));
+}
@@ -0,0 +1,121 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <filesystem>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include <propellint/BuckCache.h>
+
+#include "TemporaryDirectory.h"
+
+namespace fs = std::filesystem;
+
+class BuckCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    fs::create_directories(directory / "a/b");
+    std::ofstream(directory / ".buckconfig") << "[project]\n";
+    std::ofstream(directory / "a/BUCK") << "cpp_library(name = 'a')\n";
+    path = (directory / "index").string();
+  }
+
+  // Saves owners for a file of each directory, and loads them back.
+  std::unordered_set<std::string> getStale() {
+    BuckCache::Cache cache(path, directory.string());
+    std::unordered_set<std::string> stale;
+    const auto fresh = cache.getOwners({"a/x.cpp", "a/b/y.cpp"}, stale);
+    for (const auto& filename : stale) {
+      cache.setOwners(filename, {"//a:a"});
+    }
+    cache.save();
+    for (const auto& [_, targets] : fresh) {
+      EXPECT_EQ(targets, std::vector<std::string>{"//a:a"});
+    }
+    return stale;
+  }
+
+  const TemporaryDirectory temporary{"propellint-buck-cache"};
+  const fs::path directory = temporary.path;
+  std::string path;
+};
+
+TEST_F(BuckCacheTest, testOwnersFreshUntilBuildFileChanges) {
+  EXPECT_EQ(getStale().size(), 2);
+  EXPECT_TRUE(getStale().empty());
+
+  std::ofstream(directory / "a/BUCK") << "cpp_library(name = 'b')\n";
+  EXPECT_EQ(getStale().size(), 2);
+}
+
+TEST_F(BuckCacheTest, testNewBuildFileOnlyInvalidatesItsDirectories) {
+  getStale();
+  std::ofstream(directory / "a/b/TARGETS") << "cpp_library(name = 'b')\n";
+
+  EXPECT_EQ(getStale(), std::unordered_set<std::string>{"a/b/y.cpp"});
+}
+
+TEST_F(BuckCacheTest, testConfigurationChangeInvalidatesAll) {
+  getStale();
+  std::ofstream(directory / ".buckconfig.local") << "[cxx]\n";
+
+  EXPECT_EQ(getStale().size(), 2);
+}
+
+TEST_F(BuckCacheTest, testDatabases) {
+  const auto database = (directory / "a.json").string();
+  std::ofstream(database) << "[]";
+  {
+    BuckCache::Cache cache(path, directory.string());
+    EXPECT_FALSE(cache.getDatabase("//a:a").has_value());
+    cache.setDatabase("//a:a", database);
+    cache.save();
+  }
+
+  EXPECT_EQ(
+      BuckCache::Cache(path, directory.string()).getDatabase("//a:a"),
+      database);
+  fs::remove(database);
+  EXPECT_FALSE(BuckCache::Cache(path, directory.string())
+                   .getDatabase("//a:a")
+                   .has_value());
+}
+
+TEST_F(BuckCacheTest, testPathsWithSpaces) {
+  const auto database = (directory / "a b.json").string();
+  std::ofstream(database) << "[]";
+  {
+    BuckCache::Cache cache(path, directory.string());
+    std::unordered_set<std::string> stale;
+    cache.getOwners({"a/x y.cpp"}, stale);
+    cache.setOwners("a/x y.cpp", {"//a:a", "//a:b"});
+    cache.setDatabase("//a:a", database);
+    cache.save();
+  }
+
+  BuckCache::Cache cache(path, directory.string());
+  std::unordered_set<std::string> stale;
+  const auto owners = cache.getOwners({"a/x y.cpp"}, stale);
+  EXPECT_TRUE(stale.empty());
+  EXPECT_EQ(
+      owners.at("a/x y.cpp"), (std::vector<std::string>{"//a:a", "//a:b"}));
+  EXPECT_EQ(cache.getDatabase("//a:a"), database);
+}
+
+TEST(BuckCache, testGetPackage) {
+  EXPECT_EQ(BuckCache::getPackage("//a/b:c"), "a/b");
+  EXPECT_EQ(BuckCache::getPackage("//:c"), "");
+  EXPECT_FALSE(BuckCache::getPackage("cell//a:b").has_value());
+}
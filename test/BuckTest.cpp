@@ -0,0 +1,173 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <propellint/Buck.h>
+
+#include "TemporaryDirectory.h"
+
+namespace fs = std::filesystem;
+
+// Puts a fake buck1 first in the PATH, which fails to build any batch with a
+// target containing "broken", or the first batch with a target containing
+// "flaky", and prints the database of each target otherwise.
+class BuckTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    const auto buck = directory / "buck1";
+    std::ofstream(buck) << R"(#!/bin/sh
+echo >> calls
+targets="${2#@}"
+if grep -q broken "$targets"; then
+  echo "$(cat "$targets") is broken" >&2
+  exit 1
+fi
+if grep -q flaky "$targets" && [ ! -e flaked ]; then touch flaked; exit 1; fi
+sed 's/\(.*\)#compilation-database/"&": "\1.json"/' "$targets" |
+  paste -s -d, - | sed 's/.*/{&}/'
+)";
+    fs::permissions(buck, fs::perms::owner_all);
+    path = std::getenv("PATH");
+    setenv("PATH", (directory.string() + ":" + path).c_str(), 1);
+  }
+
+  void TearDown() override {
+    setenv("PATH", path.c_str(), 1);
+  }
+
+  std::size_t getCalls() const {
+    std::ifstream calls(directory / "calls");
+    return std::count(
+        std::istreambuf_iterator<char>(calls),
+        std::istreambuf_iterator<char>(),
+        '\n');
+  }
+
+  const TemporaryDirectory temporary{"propellint-buck"};
+  const fs::path directory = temporary.path;
+  std::string path;
+};
+
+TEST_F(BuckTest, testBisectsBrokenTargets) {
+  std::vector<std::string> targets;
+  for (int i = 0; i < 16; ++i) {
+    targets.push_back("//a:" + std::to_string(i));
+  }
+  targets[3] = "//a:broken3";
+  targets[12] = "//a:broken12";
+  const auto denyListPath = (directory / "deny-list").string();
+  Buck::DenyList denyList(denyListPath);
+  std::map<std::string, std::string> databases;
+
+  testing::internal::CaptureStderr();
+  auto broken = Buck::buildCompilationDatabasesAsync(
+      directory.string(),
+      targets,
+      1,
+      denyList,
+      [&](const std::string& target, const std::string& database) {
+        databases.emplace(target, database);
+      });
+  const auto errors = testing::internal::GetCapturedStderr();
+
+  std::sort(broken.begin(), broken.end());
+  EXPECT_EQ(broken, (std::vector<std::string>{"//a:broken12", "//a:broken3"}));
+  EXPECT_EQ(databases.size(), 14);
+  EXPECT_EQ(databases.at("//a:0"), "//a:0.json");
+  EXPECT_TRUE(denyList.contains("//a:broken3"));
+  EXPECT_EQ(Buck::DenyList(denyListPath).size(), 2);
+  EXPECT_NE(
+      errors.find("//a:broken3#compilation-database is broken"),
+      std::string::npos);
+}
+
+TEST_F(BuckTest, testRetriesFailedBatches) {
+  Buck::DenyList denyList;
+
+  const auto databases = Buck::buildCompilationDatabases2(
+      directory.string(), {"//a:0", "//a:flaky"}, denyList);
+
+  EXPECT_EQ(databases.size(), 2);
+  EXPECT_EQ(denyList.size(), 0);
+  EXPECT_EQ(getCalls(), 2);
+}
+
+TEST_F(BuckTest, testRetriesOnlyWholeBatches) {
+  std::vector<std::string> targets;
+  for (int i = 0; i < 8; ++i) {
+    targets.push_back("//a:" + std::to_string(i));
+  }
+  targets[5] = "//a:broken5";
+  Buck::DenyList denyList;
+
+  testing::internal::CaptureStderr();
+  const auto databases =
+      Buck::buildCompilationDatabases2(directory.string(), targets, denyList);
+  testing::internal::GetCapturedStderr();
+
+  EXPECT_EQ(databases.size(), 7);
+  EXPECT_TRUE(denyList.contains("//a:broken5"));
+  // The batch and its retry, then two builds for each of the three halvings.
+  EXPECT_EQ(getCalls(), 8);
+}
+
+TEST_F(BuckTest, testDenyListExpires) {
+  const auto denyListPath = (directory / "deny-list").string();
+  std::ofstream(denyListPath) << "//a:old 0\n//a:unknown\n";
+
+  Buck::DenyList denyList(denyListPath);
+  EXPECT_FALSE(denyList.contains("//a:old"));
+  EXPECT_TRUE(denyList.contains("//a:unknown"));
+  denyList.add("//a:new");
+  denyList.save();
+
+  const Buck::DenyList later(denyListPath);
+  EXPECT_EQ(later.size(), 2);
+  EXPECT_TRUE(later.contains("//a:new"));
+  EXPECT_EQ(Buck::DenyList(denyListPath, std::chrono::seconds(-1)).size(), 0);
+}
+
+TEST_F(BuckTest, testSkipsDeniedTargets) {
+  const auto denyListPath = (directory / "deny-list").string();
+  std::ofstream(denyListPath) << "//a:broken\n";
+  Buck::DenyList denyList(denyListPath);
+
+  const auto databases = Buck::buildCompilationDatabases2(
+      directory.string(), {"//a:0", "//a:broken", "//a:1"}, denyList);
+
+  EXPECT_EQ(databases.size(), 2);
+  EXPECT_EQ(getCalls(), 1);
+}
+
+TEST_F(BuckTest, testKeepsDenyListIfNothingBuilt) {
+  const auto denyListPath = (directory / "deny-list").string();
+  Buck::DenyList denyList(denyListPath);
+
+  const auto databases = Buck::buildCompilationDatabases2(
+      directory.string(), {"//a:broken1", "//a:broken2"}, denyList);
+
+  EXPECT_TRUE(databases.empty());
+  EXPECT_EQ(denyList.size(), 2);
+  EXPECT_FALSE(fs::exists(denyListPath));
+}
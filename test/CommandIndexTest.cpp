@@ -0,0 +1,85 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <propellint/CommandIndex.h>
+
+#include "TemporaryDirectory.h"
+
+namespace fs = std::filesystem;
+
+class CommandIndexTest : public testing::Test {
+ protected:
+  const TemporaryDirectory temporary{"propellint-command-index"};
+  const std::string path = (temporary.path / "commands.json").string();
+};
+
+TEST_F(CommandIndexTest, testFindsCommands) {
+  std::ofstream(path) << R"([
+    {"directory": "/d", "file": "a.cpp", "arguments": ["cc", "-DA", "a.cpp"]},
+    {"directory": "/d/b", "file": "../a.cpp", "command": "cc -DB ../a.cpp",
+     "output": "a.o"},
+    {"directory": "/d", "file": "/d/c.cpp", "command": "cc \"-DC=\\\"c\\\"\""}
+  ])";
+
+  const CommandIndex::Index index(path);
+
+  EXPECT_EQ(index.getCommands().size(), 3);
+  EXPECT_EQ(index.getFilenames().size(), 2);
+  const auto a = index.find("/d/a.cpp");
+  ASSERT_EQ(a.size(), 2);
+  EXPECT_EQ(a[0]->arguments, (std::vector<std::string>{"cc", "-DA", "a.cpp"}));
+  EXPECT_EQ(a[1]->directory, "/d/b");
+  EXPECT_EQ(a[1]->arguments[1], "-DB");
+  EXPECT_EQ(a[1]->output, "a.o");
+  const auto c = index.find("/d/./c.cpp");
+  ASSERT_EQ(c.size(), 1);
+  EXPECT_EQ(c[0]->arguments, (std::vector<std::string>{"cc", "-DC=\"c\""}));
+  EXPECT_TRUE(index.find("/d/b.cpp").empty());
+}
+
+TEST_F(CommandIndexTest, testFileSizeOfWholePages) {
+  // Nothing of the file itself can serve as padding.
+  std::string json =
+      R"([{"directory": "/d", "file": "a.cpp", "arguments": ["cc"]}])";
+  json.resize(sysconf(_SC_PAGESIZE), ' ');
+  std::ofstream(path) << json;
+
+  EXPECT_EQ(CommandIndex::Index(path).find("/d/a.cpp").size(), 1);
+}
+
+TEST_F(CommandIndexTest, testInvalidDatabases) {
+  EXPECT_THROW(CommandIndex::Index{path}, std::runtime_error);
+  std::ofstream(path) << R"({"file": "a.cpp"})";
+  EXPECT_THROW(CommandIndex::Index{path}, std::runtime_error);
+}
+
+TEST(CommandIndex, testSplitCommand) {
+  EXPECT_EQ(
+      CommandIndex::splitCommand("  cc -c  'a b.cpp'\t-DX=a\\ b -o\"\\$x\" "),
+      (std::vector<std::string>{"cc", "-c", "a b.cpp", "-DX=a b", "-o$x"}));
+  EXPECT_EQ(
+      CommandIndex::splitCommand("cc '' \"\""),
+      (std::vector<std::string>{"cc", "", ""}));
+  EXPECT_TRUE(CommandIndex::splitCommand("").empty());
+}
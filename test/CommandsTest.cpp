@@ -0,0 +1,79 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <propellint/Commands.h>
+
+#include "TemporaryDirectory.h"
+
+namespace fs = std::filesystem;
+
+class CommandsTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    path = (directory / "compile_commands.json").string();
+    std::ofstream(path) << R"([
+      {"directory": ")" << directory.string() << R"(", "file": "a.cpp",
+       "arguments": ["cc", "-DA", "a.cpp"]},
+      {"directory": ")" << directory.string() << R"(", "file": "b.cpp",
+       "command": "cc -DB b.cpp"}
+    ])";
+  }
+
+  const TemporaryDirectory temporary{"propellint-commands"};
+  const fs::path directory = temporary.path;
+  std::string path;
+};
+
+TEST_F(CommandsTest, testJsonProvider) {
+  Commands::JsonProvider provider(directory.string(), path);
+
+  const auto owners = provider.getOwners({"a.cpp", "c.cpp"});
+  ASSERT_EQ(owners.size(), 1);
+  EXPECT_EQ(owners.at("a.cpp"), std::vector{path});
+
+  std::vector<std::unique_ptr<clang::tooling::CompilationDatabase>> databases;
+  const auto missing = provider.getDatabases(
+      {path, "//other:target"},
+      [&](const std::string& target, Commands::Loader loader, uint64_t) {
+        EXPECT_EQ(target, path);
+        std::string error;
+        databases.push_back(loader(error));
+      });
+  EXPECT_EQ(missing, std::vector<std::string>{"//other:target"});
+  ASSERT_EQ(databases.size(), 1);
+  ASSERT_NE(databases[0], nullptr);
+
+  const auto commands =
+      databases[0]->getCompileCommands((directory / "b.cpp").string());
+  ASSERT_EQ(commands.size(), 1);
+  EXPECT_EQ(
+      commands[0].CommandLine,
+      (std::vector<std::string>{"cc", "-DB", "b.cpp"}));
+  EXPECT_EQ(databases[0]->getAllFiles().size(), 2);
+  EXPECT_EQ(databases[0]->getAllCompileCommands().size(), 2);
+}
+
+TEST_F(CommandsTest, testLoadDatabase) {
+  std::string error;
+  EXPECT_NE(Commands::loadDatabase(path, error), nullptr);
+  EXPECT_EQ(Commands::loadDatabase(path + ".missing", error), nullptr);
+  EXPECT_FALSE(error.empty());
+}
@@ -0,0 +1,156 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <filesystem>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include <propellint/FileCache.h>
+
+#include "TemporaryDirectory.h"
+
+namespace fs = std::filesystem;
+
+class FileCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    fs::create_directories(directory / "include");
+    std::ofstream(directory / "include/a.h") << "int a();\n";
+  }
+
+  const TemporaryDirectory temporary{"propellint-file-cache"};
+  const fs::path directory = temporary.path;
+};
+
+TEST_F(FileCacheTest, testSharedAcrossFileSystems) {
+  FileCache::Cache cache;
+  const auto first = FileCache::newFileSystem(cache);
+  const auto second = FileCache::newFileSystem(cache);
+  ASSERT_FALSE(first->setCurrentWorkingDirectory(directory.string()));
+  ASSERT_FALSE(second->setCurrentWorkingDirectory(
+      (directory / "include").string()));
+
+  const auto status = first->status("include/a.h");
+  ASSERT_TRUE(status);
+  EXPECT_EQ(status->getName(), "include/a.h");
+  EXPECT_EQ(status->getSize(), 9);
+  EXPECT_EQ(cache.getStatistics().misses, 1);
+
+  // The same file, through another working directory.
+  ASSERT_TRUE(second->status("a.h"));
+  EXPECT_EQ(cache.getStatistics().hits, 1);
+  EXPECT_EQ(cache.getStatistics().misses, 1);
+
+  // Missing files are cached too.
+  EXPECT_FALSE(first->status("include/b.h"));
+  EXPECT_FALSE(second->status("b.h"));
+  EXPECT_EQ(cache.getStatistics().misses, 2);
+}
+
+TEST_F(FileCacheTest, testContentsReadOnce) {
+  FileCache::Cache cache;
+  const auto fileSystem = FileCache::newFileSystem(cache);
+  const auto path = (directory / "include/a.h").string();
+
+  const auto buffer = fileSystem->getBufferForFile(path);
+  ASSERT_TRUE(buffer);
+  EXPECT_EQ((*buffer)->getBuffer(), "int a();\n");
+
+  // Files are assumed not to change during a run.
+  std::ofstream(path) << "int b();\n";
+  const auto cached = FileCache::newFileSystem(cache)->getBufferForFile(path);
+  ASSERT_TRUE(cached);
+  EXPECT_EQ((*cached)->getBuffer(), "int a();\n");
+  EXPECT_EQ((*cached)->getBufferIdentifier(), path);
+}
+
+TEST_F(FileCacheTest, testMainFilesNotCached) {
+  FileCache::Cache cache;
+  const auto fileSystem = FileCache::newFileSystem(cache);
+  const auto path = (directory / "a.cpp").string();
+  std::ofstream(path) << "int a();\n";
+
+  ASSERT_TRUE(fileSystem->getBufferForFile(path));
+  std::ofstream(path) << "int b();\n";
+  const auto buffer = fileSystem->getBufferForFile(path);
+  ASSERT_TRUE(buffer);
+  EXPECT_EQ((*buffer)->getBuffer(), "int b();\n");
+  EXPECT_EQ(cache.getStatistics().misses, 0);
+}
+
+TEST_F(FileCacheTest, testNormalizedPaths) {
+  FileCache::Cache cache;
+  const auto fileSystem = FileCache::newFileSystem(cache);
+  ASSERT_FALSE(fileSystem->setCurrentWorkingDirectory(directory.string()));
+
+  ASSERT_TRUE(fileSystem->status("include/./a.h"));
+  ASSERT_TRUE(fileSystem->status("include/a.h"));
+  EXPECT_EQ(cache.getStatistics().hits, 1);
+  EXPECT_EQ(cache.getStatistics().misses, 1);
+}
+
+TEST_F(FileCacheTest, testSymlinkFollowedByDotDot) {
+  fs::create_directories(directory / "toolchain/lib");
+  fs::create_directory_symlink("toolchain/lib", directory / "lib");
+  std::ofstream(directory / "toolchain/b.h") << "int toolchain();\n";
+  std::ofstream(directory / "b.h") << "int b();\n";
+
+  FileCache::Cache cache;
+  const auto fileSystem = FileCache::newFileSystem(cache);
+  ASSERT_FALSE(fileSystem->setCurrentWorkingDirectory(directory.string()));
+
+  // Goes up from the target of the link, as the kernel does.
+  ASSERT_TRUE(fileSystem->getBufferForFile("b.h"));
+  const auto buffer = fileSystem->getBufferForFile("lib/../b.h");
+  ASSERT_TRUE(buffer);
+  EXPECT_EQ((*buffer)->getBuffer(), "int toolchain();\n");
+  EXPECT_FALSE(fileSystem->status("lib/../include/a.h"));
+}
+
+TEST_F(FileCacheTest, testBoundedBuffers) {
+  // Too small for any file.
+  FileCache::Cache cache(4);
+  const auto fileSystem = FileCache::newFileSystem(cache);
+  const auto path = (directory / "include/a.h").string();
+
+  ASSERT_TRUE(fileSystem->getBufferForFile(path));
+  std::ofstream(path) << "int b();\n";
+  const auto buffer = fileSystem->getBufferForFile(path);
+  ASSERT_TRUE(buffer);
+  EXPECT_EQ((*buffer)->getBuffer(), "int b();\n");
+}
+
+TEST_F(FileCacheTest, testListDirectory) {
+  FileCache::Cache cache;
+  const auto fileSystem = FileCache::newFileSystem(cache);
+
+  for (auto i = 0; i < 2; ++i) {
+    std::error_code error;
+    std::vector<std::string> paths;
+    const auto include = (directory / "include").string();
+    for (auto it = fileSystem->dir_begin(include, error);
+         !error && it != llvm::vfs::directory_iterator();
+         it.increment(error)) {
+      paths.push_back(it->path().str());
+    }
+    EXPECT_FALSE(error);
+    EXPECT_EQ(
+        paths, std::vector<std::string>{(directory / "include/a.h").string()});
+  }
+
+  std::error_code error;
+  fileSystem->dir_begin((directory / "missing").string(), error);
+  EXPECT_TRUE(error);
+}
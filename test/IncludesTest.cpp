@@ -0,0 +1,67 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <clang/Tooling/CompilationDatabase.h>
+
+#include <gtest/gtest.h>
+
+#include <propellint/Includes.h>
+
+#include "TemporaryDirectory.h"
+
+namespace fs = std::filesystem;
+
+TEST(Includes, testIsHeader) {
+  EXPECT_TRUE(Includes::isHeader("a/b.h"));
+  EXPECT_TRUE(Includes::isHeader("a/b.hpp"));
+  EXPECT_FALSE(Includes::isHeader("a/b.cpp"));
+}
+
+TEST(Includes, testCheapestIncluder) {
+  const TemporaryDirectory temporary("propellint-includes");
+  const auto& directory = temporary.path;
+  fs::create_directories(directory / "lib");
+  std::ofstream(directory / "lib/a.h") << "int a();\n";
+  std::ofstream(directory / "lib/big.h")
+      << std::string(10'000, '\n') << "int big();\n";
+  std::ofstream(directory / "b.cpp")
+      << "#include \"lib/big.h\"\n#include \"lib/a.h\"\n";
+  std::ofstream(directory / "c.cpp") << "#include \"lib/a.h\"\n";
+  std::ofstream(directory / "d.cpp") << "int d();\n";
+
+  const clang::tooling::FixedCompilationDatabase database(
+      directory.string(), {"-I" + directory.string()});
+  Includes::Index index(directory.string(), {"lib/a.h", "lib/big.h"});
+  index.scan(
+      "//:target",
+      database,
+      {(directory / "b.cpp").string(),
+       (directory / "c.cpp").string(),
+       (directory / "d.cpp").string()});
+
+  EXPECT_EQ(index.size(), 2);
+  const auto a = index.find("lib/a.h");
+  ASSERT_TRUE(a.has_value());
+  EXPECT_EQ(a->target, "//:target");
+  EXPECT_EQ(a->filename, "c.cpp");
+  const auto big = index.find("lib/big.h");
+  ASSERT_TRUE(big.has_value());
+  EXPECT_EQ(big->filename, "b.cpp");
+  EXPECT_GT(big->cost, a->cost);
+  EXPECT_FALSE(index.find("d.cpp").has_value());
+}
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <fstream>
+#include <unordered_set>
 #include <vector>
 
 #include <clang/ASTMatchers/ASTMatchFinder.h>
@@ -22,16 +23,25 @@
 #include <gtest/gtest.h>
 
 #include <propellint/Matcher.h>
-
-static const std::string kMockMapCode = R"(
-  namespace std {
-  template<class Key, class T>
-  struct map {
-    T& operator[](const Key&);
-    T& operator[](Key&&);
-  };
-  } // namespace std
-)";
+#include <propellint/Visitor.h>
+
+#include "MockMap.h"
+
+// Counts the matches of Matcher::get(), and checks that the visitor finds the
+// same ones.
+size_t countMatches(clang::ASTUnit& AST) {
+  auto& context = AST.getASTContext();
+  const auto matches = clang::ast_matchers::match(Matcher::get(), context);
+  std::unordered_set<const clang::CXXOperatorCallExpr*> expected;
+  for (const auto& match : matches) {
+    expected.insert(match.getNodeAs<clang::CXXOperatorCallExpr>("bracket"));
+  }
+
+  const auto brackets = Visitor::find(context);
+  EXPECT_EQ(std::unordered_set(brackets.begin(), brackets.end()), expected);
+  EXPECT_EQ(brackets.size(), matches.size());
+  return matches.size();
+}
 
 TEST(Matcher, testReferenceRightSideOfVarDecl) {
   const auto code = R"(
@@ -45,9 +55,7 @@ TEST(Matcher, testReferenceRightSideOfVarDecl) {
       clang::tooling::buildASTFromCode(kMockMapCode + code);
   assert(AST != nullptr);
 
-  const auto matches =
-      clang::ast_matchers::match(Matcher::get(), AST->getASTContext());
-  EXPECT_EQ(matches.size(), 0);
+  EXPECT_EQ(countMatches(*AST), 0);
 }
 
 TEST(Matcher, testRightSideOfVarDecl) {
@@ -61,9 +69,7 @@ TEST(Matcher, testRightSideOfVarDecl) {
   const auto AST = clang::tooling::buildASTFromCode(kMockMapCode + code);
   assert(AST != nullptr);
 
-  const auto matches =
-      clang::ast_matchers::match(Matcher::get(), AST->getASTContext());
-  EXPECT_EQ(matches.size(), 1);
+  EXPECT_EQ(countMatches(*AST), 1);
 }
 
 TEST(Matcher, testRightSideOfAssignment) {
@@ -78,9 +84,7 @@ TEST(Matcher, testRightSideOfAssignment) {
   const auto AST = clang::tooling::buildASTFromCode(kMockMapCode + code);
   assert(AST != nullptr);
 
-  const auto matches =
-      clang::ast_matchers::match(Matcher::get(), AST->getASTContext());
-  EXPECT_EQ(matches.size(), 1);
+  EXPECT_EQ(countMatches(*AST), 1);
 }
 
 TEST(Matcher, testLHSOfAssignment) {
@@ -94,9 +98,7 @@ TEST(Matcher, testLHSOfAssignment) {
   const auto AST = clang::tooling::buildASTFromCode(kMockMapCode + code);
   assert(AST != nullptr);
 
-  const auto matches =
-      clang::ast_matchers::match(Matcher::get(), AST->getASTContext());
-  EXPECT_EQ(matches.size(), 0);
+  EXPECT_EQ(countMatches(*AST), 0);
 }
 
 TEST(Matcher, testLHSOfAssignmentWithObject) {
@@ -111,9 +113,7 @@ TEST(Matcher, testLHSOfAssignmentWithObject) {
   const auto AST = clang::tooling::buildASTFromCode(kMockMapCode + code);
   assert(AST != nullptr);
 
-  const auto matches =
-      clang::ast_matchers::match(Matcher::get(), AST->getASTContext());
-  EXPECT_EQ(matches.size(), 0);
+  EXPECT_EQ(countMatches(*AST), 0);
 }
 
 TEST(Matcher, testPreIncrement) {
@@ -127,9 +127,7 @@ TEST(Matcher, testPreIncrement) {
   const auto AST = clang::tooling::buildASTFromCode(kMockMapCode + code);
   assert(AST != nullptr);
 
-  const auto matches =
-      clang::ast_matchers::match(Matcher::get(), AST->getASTContext());
-  EXPECT_EQ(matches.size(), 0);
+  EXPECT_EQ(countMatches(*AST), 0);
 }
 
 TEST(Matcher, testPreDecrement) {
@@ -143,9 +141,7 @@ TEST(Matcher, testPreDecrement) {
   const auto AST = clang::tooling::buildASTFromCode(kMockMapCode + code);
   assert(AST != nullptr);
 
-  const auto matches =
-      clang::ast_matchers::match(Matcher::get(), AST->getASTContext());
-  EXPECT_EQ(matches.size(), 0);
+  EXPECT_EQ(countMatches(*AST), 0);
 }
 
 TEST(Matcher, testPostIncrement) {
@@ -159,9 +155,7 @@ TEST(Matcher, testPostIncrement) {
   const auto AST = clang::tooling::buildASTFromCode(kMockMapCode + code);
   assert(AST != nullptr);
 
-  const auto matches =
-      clang::ast_matchers::match(Matcher::get(), AST->getASTContext());
-  EXPECT_EQ(matches.size(), 0);
+  EXPECT_EQ(countMatches(*AST), 0);
 }
 
 TEST(Matcher, testPreIncrementWithObject) {
@@ -178,7 +172,66 @@ TEST(Matcher, testPreIncrementWithObject) {
   const auto AST = clang::tooling::buildASTFromCode(kMockMapCode + code);
   assert(AST != nullptr);
 
-  const auto matches =
-      clang::ast_matchers::match(Matcher::get(), AST->getASTContext());
-  EXPECT_EQ(matches.size(), 0);
+  EXPECT_EQ(countMatches(*AST), 0);
+}
+
+TEST(Matcher, testNestedContexts) {
+  const auto code = R"(
+    void f() {
+      std::map<int, int> map;
+      const auto& g = [&] { return map[0]; };
+      map[1] += 1;
+      int a[2];
+      a[map[2]] = 1;
+      (map[3]);
+      int x = map[4] + map[5];
+      ++a[map[6]];
+    }
+  )";
+
+  const auto AST = clang::tooling::buildASTFromCode(kMockMapCode + code);
+  assert(AST != nullptr);
+
+  EXPECT_EQ(countMatches(*AST), 3);
+}
+
+TEST(Matcher, testMatchSites) {
+  const auto code = R"(
+    int f(std::map<int, int>& map) {
+      return map[0];
+    }
+    struct S {
+      int g(std::map<int, int>& map) {
+        return [&map] { return map[1]; }();
+      }
+    };
+    template <class T>
+    struct M {
+      int h(std::map<int, int>& map) {
+        return map[2];
+      }
+    };
+  )";
+
+  const auto AST = clang::tooling::buildASTFromCode(kMockMapCode + code);
+  assert(AST != nullptr);
+  auto& context = AST->getASTContext();
+  const auto& SM = AST->getSourceManager();
+
+  const auto all = clang::ast_matchers::match(Matcher::get(), context);
+  ASSERT_EQ(all.size(), 3);
+  EXPECT_TRUE(Matcher::matchSites({}, context).empty());
+
+  for (const auto& expected : all) {
+    const auto* bracket =
+        expected.getNodeAs<clang::CXXOperatorCallExpr>("bracket");
+    const auto location = SM.getPresumedLoc(bracket->getExprLoc());
+    const Matcher::LineIndex index = {
+        {location.getFilename(), {location.getLine()}}};
+
+    const auto matches = Matcher::matchSites(index, context);
+    ASSERT_EQ(matches.size(), 1);
+    EXPECT_EQ(
+        matches[0].getNodeAs<clang::CXXOperatorCallExpr>("bracket"), bracket);
+  }
 }
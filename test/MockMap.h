@@ -0,0 +1,30 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// A minimal std::map, so that code calling its operator[] is parsed without
+// the standard library. Shared by the tests and the benchmarks.
+
+#include <string>
+
+inline const std::string kMockMapCode = R"(
+  namespace std {
+  template<class Key, class T>
+  struct map {
+    T& operator[](const Key&);
+    T& operator[](Key&&);
+  };
+  } // namespace std
+)";
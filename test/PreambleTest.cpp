@@ -0,0 +1,74 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <propellint/Preamble.h>
+
+TEST(Preamble, testGetIncludes) {
+  const auto code = R"(// Copyright
+/*
+ * License.
+ */
+#include "a/b.h"
+
+#  include <map> // For std::map.
+/* Inline. */ #include <vector>
+#define X
+#include <set>
+)";
+
+  EXPECT_EQ(
+      Preamble::getIncludes(code),
+      (std::vector<std::string>{
+          "#include \"a/b.h\"", "#include <map>", "#include <vector>"}));
+  EXPECT_TRUE(Preamble::getIncludes("int x;\n#include <map>\n").empty());
+  EXPECT_TRUE(Preamble::getIncludes("#include MACRO\n").empty());
+}
+
+TEST(Preamble, testGetCommonPrefix) {
+  EXPECT_EQ(
+      Preamble::getCommonPrefix({{"a", "b", "c"}, {"a", "b", "d"}, {"a", "b"}}),
+      (std::vector<std::string>{"a", "b"}));
+  EXPECT_TRUE(Preamble::getCommonPrefix({{"a"}, {"b"}}).empty());
+  EXPECT_TRUE(Preamble::getCommonPrefix({}).empty());
+}
+
+clang::tooling::CompileCommand getCommand(
+    const std::string& filename,
+    const std::string& flag) {
+  return {
+      "/d", filename, {"clang++", flag, "-c", filename, "-o", "x.o"}, "x.o"};
+}
+
+TEST(Preamble, testGetGroupKey) {
+  const auto key = Preamble::getGroupKey(getCommand("src/a.cpp", "-O2"));
+
+  EXPECT_EQ(Preamble::getGroupKey(getCommand("src/b.cpp", "-O2")), key);
+  EXPECT_NE(Preamble::getGroupKey(getCommand("src/c.cpp", "-O3")), key);
+  EXPECT_NE(Preamble::getGroupKey(getCommand("lib/d.cpp", "-O2")), key);
+}
+
+TEST(Preamble, testHash) {
+  const auto hash = Preamble::hash("key", {"#include <map>", "#include <set>"});
+
+  EXPECT_EQ(Preamble::hash("key", {"#include <map>", "#include <set>"}), hash);
+  EXPECT_NE(Preamble::hash("key", {"#include <map>"}), hash);
+  EXPECT_NE(
+      Preamble::hash("other", {"#include <map>", "#include <set>"}), hash);
+  EXPECT_NE(Preamble::hash("key", {"#include <map>#include <set>"}), hash);
+}
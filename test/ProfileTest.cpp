@@ -0,0 +1,636 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#include <gtest/gtest.h>
+
+#include <zlib.h>
+
+#include <propellint/Formats.h>
+#include <propellint/Profile.h>
+#include <propellint/ProfileCache.h>
+
+static const std::string kInsertRecord = R"({
+  "stack_combined": [
+    "main@main.cpp:3",
+    "f@a.cpp:10",
+    "std::map::operator[]@map.h:20",
+    "std::_Rb_tree::_M_emplace_hint_unique@tree.h:30"
+  ],
+  "total_weight": 5
+})";
+
+static const std::string kLookupRecord = R"({
+  "total_weight": 7,
+  "stack_combined": [
+    "g::{lambda(\"}]\")#1}::operator()@b.cpp:4",
+    "f@a.cpp:10",
+    "std::map::operator[]@map.h:20"
+  ]
+})";
+
+static const std::string kUnrelatedRecord = R"({
+  "stack_combined": ["main@main.cpp:3", "h\\@c.cpp:5"],
+  "total_weight": 11
+})";
+
+std::string makeProfile(
+    size_t repeat,
+    const std::string& separator,
+    bool array) {
+  std::string profile = array ? "[" : "";
+  for (size_t i = 0; i < repeat; ++i) {
+    profile += kInsertRecord + separator + kUnrelatedRecord + separator +
+        kLookupRecord + (i + 1 == repeat ? "" : separator);
+  }
+  return profile + (array ? "]" : "\n");
+}
+
+std::unordered_map<Profile::CallSite, Profile::Locations::Weights> toMap(
+    const Profile::Locations& locations) {
+  std::unordered_map<Profile::CallSite, Profile::Locations::Weights> map;
+  for (uint32_t i = 0; i < locations.size(); ++i) {
+    map.emplace(locations.getCallSite(i), locations.getWeights(i));
+  }
+  return map;
+}
+
+TEST(Profile, testSymbolTable) {
+  Profile::SymbolTable symbols;
+  const auto a = symbols.intern("a");
+  const auto b = symbols.intern(std::string(100'000, 'b'));
+  EXPECT_EQ(symbols.intern("a"), a);
+  EXPECT_NE(a, b);
+  EXPECT_EQ(symbols.size(), 2);
+  EXPECT_EQ(symbols[b].size(), 100'000);
+  EXPECT_EQ(symbols.find("a"), a);
+  EXPECT_FALSE(symbols.find("c").has_value());
+}
+
+TEST(Profile, testSymbolTableEmptyFirst) {
+  Profile::SymbolTable symbols;
+  const auto empty = symbols.intern("");
+  const auto a = symbols.intern("a");
+  EXPECT_EQ(symbols.intern(""), empty);
+  EXPECT_NE(a, empty);
+  EXPECT_EQ(symbols[empty], "");
+  EXPECT_EQ(symbols[a], "a");
+}
+
+TEST(Profile, testLocations) {
+  const json::padded_string json(makeProfile(1, ",", true));
+  Profile::IngestionStatistics statistics;
+  const auto locations = Profile::getOperatorBracketLocations(
+      json, Signatures::Table::getDefault(), 1, statistics);
+
+  ASSERT_EQ(locations.size(), 1);
+  const auto& weights = locations.at(Profile::CallSite("a.cpp", 10));
+  EXPECT_EQ(weights.first, 5);
+  EXPECT_EQ(weights.second, 12);
+  EXPECT_EQ(locations.find(Profile::CallSite("a.cpp", 11)), nullptr);
+}
+
+TEST(Profile, testParallelMatchesSerial) {
+  const json::padded_string json(makeProfile(100, ",\n", true));
+  Profile::IngestionStatistics serialStatistics;
+  const auto serial = Profile::getOperatorBracketLocations(
+      json, Signatures::Table::getDefault(), 1, serialStatistics);
+
+  for (size_t jobs : {2, 3, 7, 64}) {
+    Profile::IngestionStatistics statistics;
+    const auto parallel = Profile::getOperatorBracketLocations(
+        json, Signatures::Table::getDefault(), jobs, statistics);
+    EXPECT_EQ(toMap(parallel), toMap(serial));
+    EXPECT_EQ(statistics.records, 300);
+    EXPECT_EQ(statistics.skippedRecords, 100);
+    EXPECT_EQ(statistics.uniqueStacks, 2);
+  }
+}
+
+TEST(Profile, testNewlineDelimited) {
+  const json::padded_string json(makeProfile(100, "\n", false));
+  Profile::IngestionStatistics statistics;
+  const auto locations = Profile::getOperatorBracketLocations(
+      json, Signatures::Table::getDefault(), 4, statistics);
+
+  ASSERT_EQ(locations.size(), 1);
+  const auto& weights = locations.at(Profile::CallSite("a.cpp", 10));
+  EXPECT_EQ(weights.first, 500);
+  EXPECT_EQ(weights.second, 1200);
+}
+
+TEST(Profile, testFoldedStacks) {
+  const json::padded_string json(makeProfile(10, ",", true));
+  Profile::IngestionStatistics statistics;
+  const auto stacks = Profile::getFoldedStacks(
+      json, Signatures::Table::getDefault(), 3, statistics);
+
+  ASSERT_EQ(stacks.size(), 2);
+  uint64_t weight = 0;
+  for (uint32_t i = 0; i < stacks.size(); ++i) {
+    weight += stacks.getWeight(i);
+    const auto& caller = stacks.getFrame(stacks.getStack(i)[1]);
+    EXPECT_EQ(stacks.getFunctions()[caller.function], "f");
+    EXPECT_EQ(stacks.getFilenames()[caller.filename], "a.cpp");
+    EXPECT_EQ(caller.line, 10);
+  }
+  EXPECT_EQ(weight, 120);
+}
+
+TEST(Profile, testPrefilterIgnoresOtherOperatorBrackets) {
+  const json::padded_string json(std::string(R"([{
+    "stack_combined": [
+      "f@a.cpp:10",
+      "apache::thrift::field_ref::operator[]@field_ref.h:1",
+      "my::std::map::operator[]@map.h:20"
+    ],
+    "total_weight": 3
+  }])"));
+  Profile::IngestionStatistics statistics;
+
+  EXPECT_TRUE(Profile::getOperatorBracketLocations(
+                  json,
+                  Signatures::Table::getDefault(),
+                  1,
+                  statistics)
+                  .empty());
+  EXPECT_EQ(statistics.skippedRecords, 1);
+}
+
+TEST(Profile, testCustomSignatures) {
+  const auto* filename = tmpnam(nullptr);
+  std::ofstream(filename) << R"({
+    "containers": [
+      {"operator": "my::Map::operator[]", "inserts": ["my::Map::grow"]},
+      {"operator": "std::map::operator[]", "inserts": ["my::Map::grow"]}
+    ],
+    "transparent": ["my::Ref::operator[]"]
+  })";
+  const auto signatures = Signatures::Table::load(filename);
+  std::remove(filename);
+
+  const json::padded_string json(std::string(R"([{
+    "stack_combined": [
+      "f@a.cpp:10",
+      "my::Ref::operator[]@ref.h:1",
+      "my::Map::operator[]@map.h:20",
+      "my::Map::grow@map.h:30"
+    ],
+    "total_weight": 3
+  }, {
+    "stack_combined": ["f@a.cpp:11", "my::Map::operator[]@map.h:20"],
+    "total_weight": 5
+  }, )" + kInsertRecord + "]"));
+  Profile::IngestionStatistics statistics;
+  const auto locations = Profile::getOperatorBracketLocations(
+      json, signatures, 2, statistics);
+
+  ASSERT_EQ(locations.size(), 2);
+  EXPECT_EQ(locations.at(Profile::CallSite("a.cpp", 10)).first, 3);
+  EXPECT_EQ(locations.at(Profile::CallSite("a.cpp", 10)).second, 8);
+  EXPECT_EQ(locations.at(Profile::CallSite("a.cpp", 11)).first, 0);
+  EXPECT_EQ(locations.at(Profile::CallSite("a.cpp", 11)).second, 5);
+  EXPECT_NE(
+      signatures.getVersion(), Signatures::Table::getDefault().getVersion());
+}
+
+TEST(Profile, testCustomSignaturesInOtherFormats) {
+  const std::string filename = tmpnam(nullptr);
+  std::ofstream(filename) << R"({
+    "containers": [
+      {"operator": "my::Map::operator[]", "inserts": ["my::Map::grow"]}
+    ]
+  })";
+  const auto signatures = Signatures::Table::load(filename);
+
+  std::ofstream(filename) << "f@a.cpp:10;my::Map::operator[]@map.h:20;"
+                             "my::Map::grow@map.h:30 3\n"
+                             "g@b.cpp:4;std::map::operator[]@map.h:20 7\n";
+  Profile::IngestionStatistics statistics;
+  const auto locations = Profile::getOperatorBracketLocations(
+      Formats::getFoldedStacks(
+          filename,
+          Formats::Format::Folded,
+          signatures,
+          1,
+          1 << 20,
+          statistics),
+      signatures);
+  ASSERT_EQ(locations.size(), 1);
+  EXPECT_EQ(locations.at(Profile::CallSite("a.cpp", 10)).first, 3);
+
+  // Frames without operator[] are dropped by the prefilters.
+  std::ofstream(filename) << R"({
+    "containers": [{"operator": "my::Map::get", "inserts": ["my::Map::grow"]}]
+  })";
+  EXPECT_THROW(Signatures::Table::load(filename), std::invalid_argument);
+  std::remove(filename.c_str());
+}
+
+TEST(Profile, testSignatureVersion) {
+  // The same functions, in other containers or kinds.
+  const Signatures::Table table({{"A", {"B", "C"}}}, {});
+  const Signatures::Table split({{"A", {"B"}}, {"C", {}}}, {});
+  const Signatures::Table transparent({{"A", {"B"}}}, {"C"});
+  const Signatures::Table joined({{"AB", {"C"}}}, {});
+  EXPECT_NE(table.getVersion(), split.getVersion());
+  EXPECT_NE(table.getVersion(), transparent.getVersion());
+  EXPECT_NE(split.getVersion(), transparent.getVersion());
+  EXPECT_NE(table.getVersion(), joined.getVersion());
+  EXPECT_EQ(
+      table.getVersion(),
+      Signatures::Table({{"A", {"B", "C"}}}, {}).getVersion());
+}
+
+TEST(Profile, testNormalizeFunction) {
+  const std::vector<std::pair<std::string, std::string>> cases = {
+      {"std::map::operator[]", "std::map::operator[]"},
+      {"std::map<int, std::vector<int, std::allocator<int> >, std::less<int>, "
+       "std::allocator<std::pair<int const, std::vector<int> > > >::"
+       "operator[](int const&)",
+       "std::map::operator[]"},
+      {"std::__detail::_Map_base<int, std::pair<int const, int>, "
+       "std::allocator<std::pair<int const, int> >, std::__detail::_Select1st, "
+       "std::equal_to<int>, std::hash<int>, std::__detail::_Mod_range_hashing, "
+       "std::__detail::_Default_ranged_hash, "
+       "std::__detail::_Prime_rehash_policy, "
+       "std::__detail::_Hashtable_traits<false, false, true>, true>::"
+       "operator[](int&&) [clone .isra.0]",
+       "std::__detail::_Map_base::operator[]"},
+      {"std::vector<int> f<int>(int) const", "f"},
+      {"unsigned long (anonymous namespace)::g[abi:cxx11](char const*)",
+       "(anonymous namespace)::g"},
+      {"h(int)::{lambda(int)#1}::operator()(int) const",
+       "h::{lambda(int)#1}::operator()"},
+      {"bool operator< <int>(A<int> const&, A<int> const&)", "operator<"},
+      {"S::operator<<(int)", "S::operator<<"},
+      {"S::operator new[](unsigned long)", "S::operator new[]"},
+      {"S::operator std::basic_string<char>() const",
+       "S::operator std::basic_string<char>"},
+      {"k (inlined)", "k"},
+      {"k.cold", "k"},
+      {"memcpy@GLIBC_2.14", "memcpy"},
+  };
+  for (const auto& [raw, normalized] : cases) {
+    EXPECT_EQ(Profile::normalizeFunction(raw), normalized) << raw;
+  }
+}
+
+TEST(Profile, testNormalizeFrames) {
+  const std::string profile = R"([
+    {"stack_combined": ["f@a.cpp:10",
+      "std::map<int, int>::operator[](int const&)@map.h:20",
+      "std::_Rb_tree<int>::_M_emplace_hint_unique<int>(int&&)@tree.h:30"],
+     "total_weight": 5},
+    {"stack_combined": ["f@a.cpp:10",
+      "std::map<long, int>::operator[](long&&) [clone .isra.0]@map.h:20"],
+     "total_weight": 7},
+    {"stack_combined": ["g@b.cpp:4",
+      "std::unordered_map<int, int>::operator[]@unordered_map.h:5"],
+     "total_weight": 3}
+  ])";
+  const auto& signatures = Signatures::Table::getDefault();
+
+  // Raw frames are only kept by the prefilter if they are to be normalized.
+  Profile::IngestionStatistics skippedStatistics;
+  EXPECT_EQ(
+      Profile::getFoldedStacks(
+          json::padded_string(profile), signatures, 1, skippedStatistics)
+          .size(),
+      0);
+  EXPECT_EQ(skippedStatistics.skippedRecords, 3);
+
+  Profile::IngestionStatistics statistics;
+  const auto raw = Profile::getFoldedStacks(
+      json::padded_string(profile), signatures, 1, statistics, true);
+  EXPECT_EQ(statistics.skippedRecords, 0);
+  EXPECT_TRUE(Profile::getOperatorBracketLocations(raw, signatures).empty());
+
+  const auto stacks = Profile::normalizeFrames(raw);
+  EXPECT_EQ(stacks.size(), 3);
+  EXPECT_EQ(stacks.getFunctions().size(), 5);
+  const auto locations =
+      Profile::getOperatorBracketLocations(stacks, signatures);
+  ASSERT_EQ(locations.size(), 2);
+  EXPECT_EQ(
+      locations.at(Profile::CallSite("a.cpp", 10)),
+      Profile::Locations::Weights(5, 12));
+  EXPECT_EQ(
+      locations.at(Profile::CallSite("b.cpp", 4)),
+      Profile::Locations::Weights(0, 3));
+}
+
+TEST(Profile, testStreaming) {
+  const std::string filename = tmpnam(nullptr);
+  const auto& signatures = Signatures::Table::getDefault();
+
+  for (const auto array : {true, false}) {
+    const auto profile = makeProfile(50, array ? ",\n" : "\n", array);
+    std::ofstream(filename) << profile;
+
+    Profile::IngestionStatistics expectedStatistics;
+    const auto expected = Profile::getOperatorBracketLocations(
+        Profile::getFoldedStacks(
+            json::padded_string(profile), signatures, 1, expectedStatistics),
+        signatures);
+    for (size_t windowSize : {1, 100, 1000, 1'000'000}) {
+      Profile::IngestionStatistics statistics;
+      const auto locations = Profile::getOperatorBracketLocations(
+          Profile::getFoldedStacks(
+              filename, signatures, 3, windowSize, statistics),
+          signatures);
+      EXPECT_EQ(toMap(locations), toMap(expected));
+      EXPECT_EQ(statistics.records, 150);
+    }
+  }
+
+  std::remove(filename.c_str());
+}
+
+TEST(Profile, testCache) {
+  const std::string profile = tmpnam(nullptr);
+  const std::string cache = tmpnam(nullptr);
+  std::ofstream(profile) << makeProfile(10, ",", true);
+
+  const auto& signatures = Signatures::Table::getDefault();
+  const auto source = ProfileCache::getSource(profile, 2);
+  EXPECT_FALSE(ProfileCache::load(cache, source, signatures).has_value());
+
+  const json::padded_string json = json::padded_string::load(profile);
+  Profile::IngestionStatistics statistics;
+  const auto stacks = Profile::getFoldedStacks(json, signatures, 2, statistics);
+  const auto locations =
+      Profile::getOperatorBracketLocations(stacks, signatures);
+  ProfileCache::save(cache, source, signatures, locations, &stacks);
+
+  const auto content = ProfileCache::load(cache, source, signatures);
+  ASSERT_TRUE(content.has_value());
+  EXPECT_EQ(toMap(content->locations), toMap(locations));
+  ASSERT_TRUE(content->stacks.has_value());
+  EXPECT_EQ(
+      toMap(Profile::getOperatorBracketLocations(*content->stacks, signatures)),
+      toMap(locations));
+
+  auto modified = source;
+  ++modified.hash;
+  EXPECT_FALSE(ProfileCache::load(cache, modified, signatures).has_value());
+  const Signatures::Table other({{"a::operator[]", {"a::insert"}}}, {});
+  EXPECT_FALSE(ProfileCache::load(cache, source, other).has_value());
+
+  // The locations keep the mapped cache they point into.
+  const auto moved =
+      std::move(ProfileCache::load(cache, source, signatures)->locations);
+  EXPECT_EQ(toMap(moved), toMap(locations));
+
+  // A size which overflows once multiplied, after the header and its size.
+  {
+    std::fstream file(cache, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(64);
+    const uint64_t size = (uint64_t(1) << 61) + 1;
+    file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  }
+  EXPECT_FALSE(ProfileCache::load(cache, source, signatures).has_value());
+
+  std::remove(profile.c_str());
+  std::remove(cache.c_str());
+}
+
+// The records of makeProfile(1, ...) in the other formats.
+static const std::string kFoldedProfile =
+    "main@main.cpp:3;f@a.cpp:10;std::map::operator[]@map.h:20;"
+    "std::_Rb_tree::_M_emplace_hint_unique@tree.h:30 5\n"
+    "main@main.cpp:3;h@c.cpp:5 11\n"
+    "g@b.cpp:4;f@a.cpp:10;std::map::operator[]@map.h:20 7\n";
+
+static const std::string kPerfScriptProfile =
+    "prog 1 [000] 1.0: 5 cycles:\n"
+    "\t1000 std::_Rb_tree::_M_emplace_hint_unique+0x10 (/bin/prog)\n"
+    "  tree.h:30\n"
+    "\t2000 std::map::operator[]+0x4 (/bin/prog)\n"
+    "  map.h:20\n"
+    "\t3000 f (/bin/prog)\n"
+    "  a.cpp:10\n"
+    "\t4000 main (/bin/prog)\n"
+    "  main.cpp:3\n"
+    "\n"
+    "prog 1 [000] 2.0: 11 cycles:\n"
+    "\t5000 h (/bin/prog)\n"
+    "\t4000 main (/bin/prog)\n"
+    "\n"
+    "prog 1 [000] 3.0: 7 cycles:\n"
+    "\t2000 std::map::operator[]+0x4 (/bin/prog)\n"
+    "  map.h:20\n"
+    "\t3000 f (/bin/prog)\n"
+    "  a.cpp:10\n"
+    "\t6000 g (/bin/prog)\n"
+    "  b.cpp:4\n";
+
+void writeVarint(std::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out += char(value | 0x80);
+    value >>= 7;
+  }
+  out += char(value);
+}
+
+void writeVarintField(std::string& out, uint32_t field, uint64_t value) {
+  writeVarint(out, field << 3);
+  writeVarint(out, value);
+}
+
+void writeBytesField(
+    std::string& out,
+    uint32_t field,
+    const std::string& bytes) {
+  writeVarint(out, field << 3 | 2);
+  writeVarint(out, bytes.size());
+  out += bytes;
+}
+
+std::string makePprofProfile() {
+  std::string profile;
+  const auto addSample = [&profile](
+                             std::vector<uint64_t> locations, uint64_t weight) {
+    std::string packed;
+    for (const auto location : locations) {
+      writeVarint(packed, location);
+    }
+    std::string sample;
+    writeBytesField(sample, 1, packed);
+    std::string values;
+    writeVarint(values, 1);
+    writeVarint(values, weight);
+    writeBytesField(sample, 2, values);
+    writeBytesField(profile, 2, sample);
+  };
+  // Samples come first, and the last location has an inlined frame.
+  addSample({4, 3, 2, 1}, 5);
+  addSample({6, 1}, 11);
+  addSample({5, 7}, 7);
+
+  // Functions and locations 1 to 4 are main, f, operator[] and insert. h only
+  // has an address.
+  const std::vector<std::pair<uint64_t, uint64_t>> lines = {
+      {1, 3}, {2, 10}, {3, 20}, {4, 30}};
+  for (uint64_t id = 1; id <= 6; ++id) {
+    std::string location;
+    writeVarintField(location, 1, id);
+    if (id <= lines.size()) {
+      std::string line;
+      writeVarintField(line, 1, lines[id - 1].first);
+      writeVarintField(line, 2, lines[id - 1].second);
+      writeBytesField(location, 4, line);
+    } else if (id == 5) {
+      // operator[] inlined into f.
+      for (const auto& [function, number] :
+           {std::pair(3, 20), std::pair(2, 10)}) {
+        std::string line;
+        writeVarintField(line, 1, function);
+        writeVarintField(line, 2, number);
+        writeBytesField(location, 4, line);
+      }
+    } else {
+      writeVarintField(location, 3, 0x1234);
+    }
+    writeBytesField(profile, 4, location);
+  }
+  std::string location;
+  writeVarintField(location, 1, 7);
+  std::string line;
+  writeVarintField(line, 1, 6);
+  writeVarintField(line, 2, 4);
+  writeBytesField(location, 4, line);
+  writeBytesField(profile, 4, location);
+
+  const std::vector<std::string> strings = {
+      "",
+      "main",
+      "main.cpp",
+      "f",
+      "a.cpp",
+      "std::map::operator[]",
+      "map.h",
+      "std::_Rb_tree::_M_emplace_hint_unique",
+      "tree.h",
+      "h",
+      "c.cpp",
+      "g",
+      "b.cpp"};
+  for (uint64_t id = 1; id <= 6; ++id) {
+    std::string function;
+    writeVarintField(function, 1, id);
+    writeVarintField(function, 2, 2 * id - 1);
+    writeVarintField(function, 4, 2 * id);
+    writeBytesField(profile, 5, function);
+  }
+  for (const auto& string : strings) {
+    writeBytesField(profile, 6, string);
+  }
+  return profile;
+}
+
+// The records of kFoldedProfile without any location, as in folded stacks
+// without '@' or perf script without srcline.
+static const std::string kLocationlessFoldedProfile =
+    "main;f;std::map::operator[];std::_Rb_tree::_M_emplace_hint_unique 5\n"
+    "main;h 11\n"
+    "g;f;std::map::operator[] 7\n";
+
+static const std::string kLocationlessPerfScriptProfile =
+    "prog 1 [000] 1.0: 5 cycles:\n"
+    "\t1000 std::_Rb_tree::_M_emplace_hint_unique+0x10 (/bin/prog)\n"
+    "\t2000 std::map::operator[]+0x4 (/bin/prog)\n"
+    "\t3000 f (/bin/prog)\n"
+    "\t4000 main (/bin/prog)\n"
+    "\n"
+    "prog 1 [000] 2.0: 11 cycles:\n"
+    "\t5000 h (/bin/prog)\n"
+    "\t4000 main (/bin/prog)\n"
+    "\n"
+    "prog 1 [000] 3.0: 7 cycles:\n"
+    "\t2000 std::map::operator[]+0x4 (/bin/prog)\n"
+    "\t3000 f (/bin/prog)\n"
+    "\t6000 g (/bin/prog)\n";
+
+TEST(Profile, testLocationlessFrames) {
+  const auto& signatures = Signatures::Table::getDefault();
+  const std::string filename = tmpnam(nullptr);
+  const auto check = [&](Formats::Format format) {
+    EXPECT_EQ(Formats::detect(filename), format);
+    Profile::IngestionStatistics statistics;
+    const auto locations = Profile::getOperatorBracketLocations(
+        Formats::getFoldedStacks(
+            filename, format, signatures, 1, 1 << 20, statistics),
+        signatures);
+    ASSERT_EQ(locations.size(), 1);
+    EXPECT_EQ(locations.getCallSite(0), Profile::CallSite("", -1));
+    EXPECT_EQ(locations.getWeights(0), Profile::Locations::Weights(5, 12));
+  };
+
+  std::ofstream(filename) << kLocationlessFoldedProfile;
+  check(Formats::Format::Folded);
+  std::ofstream(filename) << kLocationlessPerfScriptProfile;
+  check(Formats::Format::PerfScript);
+
+  std::remove(filename.c_str());
+}
+
+TEST(Profile, testFormats) {
+  const auto& signatures = Signatures::Table::getDefault();
+  Profile::IngestionStatistics expectedStatistics;
+  const auto expected = Profile::getOperatorBracketLocations(
+      Profile::getFoldedStacks(
+          json::padded_string(makeProfile(1, ",", true)),
+          signatures,
+          1,
+          expectedStatistics),
+      signatures);
+
+  const std::string filename = tmpnam(nullptr);
+  const auto check = [&](Formats::Format format) {
+    EXPECT_EQ(Formats::detect(filename), format);
+    Profile::IngestionStatistics statistics;
+    const auto locations = Profile::getOperatorBracketLocations(
+        Formats::getFoldedStacks(
+            filename, format, signatures, 1, 1 << 20, statistics),
+        signatures);
+    EXPECT_EQ(toMap(locations), toMap(expected));
+    EXPECT_EQ(statistics.records, 3);
+    EXPECT_EQ(statistics.skippedRecords, 1);
+  };
+
+  std::ofstream(filename) << makeProfile(1, "\n", false);
+  check(Formats::Format::Json);
+  std::ofstream(filename) << kFoldedProfile;
+  check(Formats::Format::Folded);
+  std::ofstream(filename) << kPerfScriptProfile;
+  check(Formats::Format::PerfScript);
+  std::ofstream(filename, std::ios::binary) << makePprofProfile();
+  check(Formats::Format::Pprof);
+
+  const auto pprof = makePprofProfile();
+  const auto file = gzopen(filename.c_str(), "wb");
+  gzwrite(file, pprof.data(), pprof.size());
+  gzclose(file);
+  check(Formats::Format::Pprof);
+
+  EXPECT_EQ(Formats::parse("perf"), Formats::Format::PerfScript);
+  EXPECT_THROW(Formats::parse("csv"), std::invalid_argument);
+
+  std::remove(filename.c_str());
+}
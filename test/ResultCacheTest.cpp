@@ -0,0 +1,89 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <filesystem>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include <propellint/ResultCache.h>
+
+#include "TemporaryDirectory.h"
+
+namespace fs = std::filesystem;
+
+class ResultCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    fs::create_directories(directory / "src");
+    write("src/a.cpp", "#include \"a.h\"\n");
+    write("src/a.h", "int a();\n");
+  }
+
+  void write(const std::string& filename, const std::string& contents) {
+    std::ofstream(directory / filename) << contents;
+  }
+
+  const TemporaryDirectory temporary{"propellint-result-cache"};
+  const fs::path directory = temporary.path;
+};
+
+TEST_F(ResultCacheTest, testRoundTrip) {
+  const auto main = (directory / "src/a.cpp").string();
+  const std::vector<ResultCache::Line> lines = {
+      {"src/a.cpp", 3, true}, {"src/a.h", 7, false}};
+
+  ResultCache::Cache cache((directory / "cache").string());
+  const auto key = cache.getKey(main, directory, {"clang++", "-O2"}, "matcher");
+  ASSERT_TRUE(key.has_value());
+  EXPECT_FALSE(cache.load(*key).has_value());
+  cache.save(*key, directory / "src", {"a.cpp", "a.h"}, lines);
+
+  // A new cache, as in a later run.
+  ResultCache::Cache later((directory / "cache").string());
+  EXPECT_EQ(
+      later.getKey(main, directory, {"clang++", "-O2"}, "matcher"), key);
+  const auto entry = later.load(*key);
+  ASSERT_TRUE(entry.has_value());
+  EXPECT_EQ(entry->lines, lines);
+  ASSERT_EQ(entry->dependencies.size(), 2);
+  EXPECT_EQ(entry->dependencies[1].first, (directory / "src/a.h").string());
+}
+
+TEST_F(ResultCacheTest, testKey) {
+  const auto main = (directory / "src/a.cpp").string();
+  ResultCache::Cache cache((directory / "cache").string());
+  const auto key = cache.getKey(main, directory, {"clang++", "-O2"}, "matcher");
+
+  EXPECT_NE(cache.getKey(main, directory, {"clang++", "-O3"}, "matcher"), key);
+  EXPECT_NE(cache.getKey(main, directory, {"clang++", "-O2"}, "visitor"), key);
+  EXPECT_NE(cache.getKey(main, "/", {"clang++", "-O2"}, "matcher"), key);
+  EXPECT_FALSE(
+      cache.getKey((directory / "missing.cpp").string(), directory, {}, "")
+          .has_value());
+}
+
+TEST_F(ResultCacheTest, testChangedDependency) {
+  const auto main = (directory / "src/a.cpp").string();
+  {
+    ResultCache::Cache cache((directory / "cache").string());
+    const auto key = cache.getKey(main, directory, {}, "matcher");
+    cache.save(*key, directory / "src", {"a.cpp", "a.h"}, {});
+  }
+
+  write("src/a.h", "int a(int);\n");
+  ResultCache::Cache cache((directory / "cache").string());
+  const auto key = cache.getKey(main, directory, {}, "matcher");
+  EXPECT_FALSE(cache.load(*key).has_value());
+}
@@ -0,0 +1,224 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <propellint/Scheduler.h>
+
+TEST(Scheduler, testRunsEachTaskOnce) {
+  std::vector<Scheduler::Task> tasks;
+  for (std::size_t i = 0; i < 100; ++i) {
+    tasks.push_back({i, i % 7});
+  }
+  std::vector<std::atomic<int>> runs(tasks.size());
+
+  const auto statistics = Scheduler::run(
+      tasks, 4, [&](std::size_t id) { runs[id].fetch_add(1); });
+
+  for (const auto& count : runs) {
+    EXPECT_EQ(count.load(), 1);
+  }
+  ASSERT_EQ(statistics.workers.size(), 4);
+  std::size_t total = 0;
+  for (const auto& worker : statistics.workers) {
+    total += worker.tasks;
+    EXPECT_LE(worker.busySeconds, statistics.wallSeconds);
+  }
+  EXPECT_EQ(total, tasks.size());
+}
+
+TEST(Scheduler, testLargestFirst) {
+  const std::vector<Scheduler::Task> tasks = {
+      {0, 10}, {1, 30}, {2, 20}, {3, 30}};
+  std::vector<std::size_t> order;
+
+  Scheduler::run(tasks, 1, [&](std::size_t id) { order.push_back(id); });
+
+  EXPECT_EQ(order, (std::vector<std::size_t>{1, 3, 2, 0}));
+}
+
+TEST(Scheduler, testStealsFromBusyWorkers) {
+  // The long task waits for the short ones, so they can only all run if the
+  // long task or the short ones dealt with it are stolen.
+  std::vector<Scheduler::Task> tasks = {{0, 1000}};
+  for (std::size_t i = 1; i <= 10; ++i) {
+    tasks.push_back({i, 1});
+  }
+  std::atomic<std::size_t> done = 0;
+
+  const auto statistics = Scheduler::run(tasks, 2, [&](std::size_t id) {
+    if (id != 0) {
+      done.fetch_add(1);
+      return;
+    }
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (done.load() < 10 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+
+  EXPECT_EQ(done.load(), 10);
+  std::size_t stolen = 0;
+  for (const auto& worker : statistics.workers) {
+    stolen += worker.stolenTasks;
+  }
+  EXPECT_GE(stolen, 1);
+}
+
+TEST(Scheduler, testMemoryBudget) {
+  EXPECT_GT(Scheduler::getResidentBytes(), 0);
+  // The peak is updated lazily, and may be behind the current size.
+  EXPECT_GT(Scheduler::getPeakResidentBytes(), 0);
+
+  std::vector<Scheduler::Task> tasks;
+  for (std::size_t i = 0; i < 20; ++i) {
+    tasks.push_back({i, 1});
+  }
+  std::atomic<int> running = 0;
+  std::atomic<int> maxRunning = 0;
+
+  // The budget is always exceeded, so tasks run one at a time.
+  const auto statistics = Scheduler::run(
+      tasks,
+      4,
+      [&](std::size_t) {
+        const auto current = running.fetch_add(1) + 1;
+        auto max = maxRunning.load();
+        while (current > max && !maxRunning.compare_exchange_weak(max, current))
+          ;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        running.fetch_sub(1);
+      },
+      1);
+
+  EXPECT_EQ(maxRunning.load(), 1);
+  std::size_t total = 0;
+  for (const auto& worker : statistics.workers) {
+    total += worker.tasks;
+  }
+  EXPECT_EQ(total, tasks.size());
+}
+
+TEST(Scheduler, testMemoryReservations) {
+  constexpr std::size_t kTaskBytes = 32 << 20;
+  std::vector<Scheduler::Task> tasks;
+  for (std::size_t i = 0; i < 4; ++i) {
+    tasks.push_back({i, 1});
+  }
+  std::mutex buffersMutex;
+  std::vector<std::vector<char>> buffers;
+  std::atomic<int> running = 0;
+  std::atomic<int> maxRunning = 0;
+
+  // Each task grows the process by more than half of the remaining budget, so
+  // the tasks admitted together would exceed it.
+  Scheduler::run(
+      tasks,
+      4,
+      [&](std::size_t) {
+        const auto current = running.fetch_add(1) + 1;
+        auto max = maxRunning.load();
+        while (current > max && !maxRunning.compare_exchange_weak(max, current))
+          ;
+        std::vector<char> buffer(kTaskBytes, 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        {
+          const std::lock_guard lock(buffersMutex);
+          buffers.push_back(std::move(buffer));
+        }
+        running.fetch_sub(1);
+      },
+      Scheduler::getResidentBytes() + kTaskBytes * 3 / 2);
+
+  EXPECT_EQ(maxRunning.load(), 1);
+  EXPECT_EQ(buffers.size(), tasks.size());
+}
+
+TEST(Scheduler, testNoTasks) {
+  const auto statistics = Scheduler::run({}, 3, [](std::size_t) { FAIL(); });
+
+  ASSERT_EQ(statistics.workers.size(), 3);
+  for (const auto& worker : statistics.workers) {
+    EXPECT_EQ(worker.tasks, 0);
+  }
+}
+
+TEST(Scheduler, testPoolRunsTasksAddedLater) {
+  std::vector<std::atomic<int>> runs(8);
+  Scheduler::Pool pool(2, [&](std::size_t id) { runs[id].fetch_add(1); });
+
+  pool.add({{0, 1}, {1, 2}, {2, 3}});
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  pool.add({{3, 1}, {4, 1}, {5, 1}, {6, 1}, {7, 1}});
+  const auto statistics = pool.finish();
+
+  for (const auto& count : runs) {
+    EXPECT_EQ(count.load(), 1);
+  }
+  std::size_t total = 0;
+  for (const auto& worker : statistics.workers) {
+    total += worker.tasks;
+  }
+  EXPECT_EQ(total, runs.size());
+}
+
+TEST(Scheduler, testPoolKeepsQueuesSorted) {
+  std::atomic<bool> started = false;
+  std::atomic<bool> release = false;
+  std::vector<std::size_t> order;
+  Scheduler::Pool pool(1, [&](std::size_t id) {
+    if (id == 0) {
+      started = true;
+      while (!release) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    order.push_back(id);
+  });
+
+  pool.add({{0, 100}});
+  while (!started) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  pool.add({{1, 1}, {2, 3}});
+  pool.add({{3, 2}, {4, 3}, {5, 1}});
+  release = true;
+  pool.finish();
+
+  EXPECT_EQ(order, (std::vector<std::size_t>{0, 2, 4, 3, 1, 5}));
+}
+
+TEST(Scheduler, testPoolRunsTasksAddedByTasks) {
+  std::atomic<std::size_t> runs = 0;
+  std::optional<Scheduler::Pool> pool;
+  pool.emplace(3, [&](std::size_t id) {
+    ++runs;
+    if (id < 50) {
+      pool->add({{id + 1, 1}});
+    }
+  });
+
+  pool->add({{0, 1}});
+  pool->finish();
+
+  EXPECT_EQ(runs.load(), 51);
+}
@@ -0,0 +1,65 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <propellint/Subprocess.h>
+
+TEST(Subprocess, testResults) {
+  const std::vector<std::string> commands = {
+      "echo first", "exit 3", "head -c 1000000 /dev/zero", "printf 'a\\nb'"};
+  std::vector<Subprocess::Result> results(commands.size(), {-2, ""});
+
+  Subprocess::run(commands, 2, [&](std::size_t index, auto result) {
+    results.at(index) = std::move(result);
+  });
+
+  EXPECT_EQ(results[0].status, 0);
+  EXPECT_EQ(results[0].output, "first\n");
+  ASSERT_TRUE(WIFEXITED(results[1].status));
+  EXPECT_EQ(WEXITSTATUS(results[1].status), 3);
+  EXPECT_EQ(results[2].output.size(), 1000000);
+  EXPECT_EQ(results[3].output, "a\nb");
+}
+
+TEST(Subprocess, testReportsAsSoonAsDone) {
+  std::vector<std::size_t> order;
+
+  Subprocess::run(
+      {"sleep 0.5; echo slow", "echo fast"},
+      2,
+      [&](std::size_t index, auto) { order.push_back(index); });
+
+  EXPECT_EQ(order, (std::vector<std::size_t>{1, 0}));
+}
+
+TEST(Subprocess, testBoundedConcurrency) {
+  // Each command fails if another one is running.
+  const auto lock = "/tmp/propellint-subprocess-" + std::to_string(getpid());
+  const auto command = "mkdir " + lock + " && sleep 0.05 && rmdir " + lock;
+  std::vector<int> statuses;
+
+  Subprocess::run(
+      std::vector<std::string>(4, command), 1, [&](std::size_t, auto result) {
+        statuses.push_back(result.status);
+      });
+
+  EXPECT_EQ(statuses, std::vector<int>(4, 0));
+}
@@ -0,0 +1,53 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// A new empty directory for a test, removed with everything in it once
+// destroyed.
+
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+class TemporaryDirectory {
+ public:
+  // The name of the directory starts with `prefix`, and is unique even across
+  // processes.
+  explicit TemporaryDirectory(const std::string& prefix)
+      : path(create(prefix)) {}
+
+  TemporaryDirectory(const TemporaryDirectory&) = delete;
+
+  ~TemporaryDirectory() {
+    std::error_code error;
+    std::filesystem::remove_all(path, error);
+  }
+
+  const std::filesystem::path path;
+
+ private:
+  static std::filesystem::path create(const std::string& prefix) {
+    auto name =
+        (std::filesystem::temp_directory_path() / (prefix + "-XXXXXX"))
+            .string();
+    if (mkdtemp(name.data()) == nullptr) {
+      throw std::runtime_error(
+          "Could not create a temporary directory for " + prefix + ".");
+    }
+    return name;
+  }
+};
@@ -0,0 +1,126 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <filesystem>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include <simdjson.h>
+
+#include <propellint/Trace.h>
+
+#include "TemporaryDirectory.h"
+
+namespace fs = std::filesystem;
+namespace json = simdjson;
+
+class TraceTest : public testing::Test {
+ protected:
+  const TemporaryDirectory temporary{"propellint-trace"};
+  const fs::path path = temporary.path / "trace.json";
+};
+
+TEST_F(TraceTest, testDisabled) {
+  EXPECT_FALSE(Trace::isEnabled());
+  {
+    Trace::Span span("Ignored");
+    span.addArgument("bytes", 1);
+  }
+  Trace::counter("Ignored", 1);
+  EXPECT_TRUE(Trace::stop());
+  EXPECT_FALSE(fs::exists(path));
+}
+
+TEST_F(TraceTest, testSpansAndCounters) {
+  Trace::start(path.string());
+  ASSERT_TRUE(Trace::isEnabled());
+  Trace::setThreadName("main");
+  {
+    Trace::Span span("Parse \"profile\"");
+    span.addArgument("bytes", 42);
+    span.addArgument("path", "a/b.cpp");
+  }
+  std::thread([] {
+    Trace::setThreadName("worker");
+    Trace::Span span("Process file", "file");
+  }).join();
+  Trace::counter("Resident bytes", 1024);
+  ASSERT_TRUE(Trace::stop());
+  EXPECT_FALSE(Trace::isEnabled());
+
+  json::dom::parser parser;
+  const json::dom::element trace = parser.load(path.string());
+  std::map<std::string, uint64_t> threads;
+  std::map<std::string, json::dom::element> events;
+  for (const auto event : trace["traceEvents"].get_array()) {
+    const auto name = std::string(event["name"].get_string().value());
+    if (std::string_view(event["ph"]) == "M") {
+      threads[std::string(event["args"]["name"].get_string().value())] =
+          event["tid"];
+    } else {
+      events[name] = event;
+    }
+  }
+
+  ASSERT_EQ(threads.size(), 2);
+  EXPECT_NE(threads["main"], threads["worker"]);
+  ASSERT_EQ(events.size(), 3);
+
+  const auto parse = events["Parse \"profile\""];
+  EXPECT_EQ(std::string_view(parse["ph"]), "X");
+  EXPECT_EQ(std::string_view(parse["cat"]), "phase");
+  EXPECT_EQ(uint64_t(parse["tid"]), threads["main"]);
+  EXPECT_GE(int64_t(parse["dur"]), 0);
+  EXPECT_EQ(int64_t(parse["args"]["bytes"]), 42);
+  EXPECT_EQ(std::string_view(parse["args"]["path"]), "a/b.cpp");
+
+  const auto file = events["Process file"];
+  EXPECT_EQ(std::string_view(file["cat"]), "file");
+  EXPECT_EQ(uint64_t(file["tid"]), threads["worker"]);
+
+  const auto resident = events["Resident bytes"];
+  EXPECT_EQ(std::string_view(resident["ph"]), "C");
+  EXPECT_EQ(int64_t(resident["args"]["Resident bytes"]), 1024);
+
+  // Events are only written once, while the threads keep their names.
+  Trace::start(path.string());
+  ASSERT_TRUE(Trace::stop());
+  const json::dom::element again = parser.load(path.string());
+  for (const auto event : again["traceEvents"].get_array()) {
+    EXPECT_EQ(std::string_view(event["ph"]), "M");
+  }
+}
+
+TEST_F(TraceTest, testEscapesInvalidUtf8) {
+  Trace::start(path.string());
+  {
+    Trace::Span span("Process file", "file");
+    span.addArgument("path", "caf\xc3\xa9/\xff\xed\xa0\x80.cpp");
+  }
+  ASSERT_TRUE(Trace::stop());
+
+  json::dom::parser parser;
+  const json::dom::element trace = parser.load(path.string());
+  std::size_t spans = 0;
+  for (const auto event : trace["traceEvents"].get_array()) {
+    if (std::string_view(event["ph"]) == "X") {
+      ++spans;
+      EXPECT_EQ(
+          std::string_view(event["args"]["path"]),
+          "caf\xc3\xa9/\xc3\xbf\xc3\xad\xc2\xa0\xc2\x80.cpp");
+    }
+  }
+  EXPECT_EQ(spans, 1);
+}